@@ -1,171 +1,553 @@
 #include "Graph.h"
 #include "Utility/ThreadMap.h"
-#include "Graphs/GL_Util.h"
-#include "Utility/Recorder.h"
 #include "Point.h"
-#include <GL/gl.h>
+#include "Kernels/Kernels.h"
+#include "Utility/Numa.h"
+#include "Graphs/Downsample.h"
 #include <thread>
+#include <sstream>
+#include <chrono>
 
-struct Wave
+template<typename T> struct Plan;
+
+template<typename T> struct Wave
 {
+	typedef typename Metric<T>::S S;
+
 	// after update, the current state is always in U
-	std::vector<Point> U, U0;
+	Field<T>  U, U0; // only the fields, they are all that changes
+	Metric<T> g;     // static, so U and U0 share it
+	int w, h;        // grid size, borders not counted
+	bool wrapped;    // are the borders of U current (see wrap_row)? Not after an unblocked frame
+
+	Wave() : mem(NULL), n(0) { clear(); }
+	~Wave() { clear(); }
+
+	size_t size() const { return n; } // number of points in every plane
+
+	/// Rows are padded, so the first inner point of every row starts a cache line
+	static int row_pitch(int w)
+	{
+		const int L = 64 / sizeof(T);
+		return (w + 2 * Point::OVERLAP + L-1) / L * L;
+	}
+
+	void resize(size_t n_) // n_ = row_pitch * number of rows (including borders)
+	{
+		if (n_ == n) return;
+		clear();
+		if (!n_) return;
+
+		// every plane gets shifted so index OVERLAP (the first inner point) is aligned
+		const size_t L = 64 / sizeof(T), LS = 64 / sizeof(S);
+		const size_t pitch  = (n_ + 2*L  - 1) & ~(L  - 1), off  = (L  - Point::OVERLAP % L ) % L;
+		const size_t gpitch = (n_ + 2*LS - 1) & ~(LS - 1), goff = (LS - Point::OVERLAP % LS) % LS;
+		const size_t bytes = 2 * Field<T>::PLANES * pitch * sizeof(T) + 3 * gpitch * sizeof(S);
+		#ifdef _WINDOWS
+		mem = (char*)_aligned_malloc(bytes, 64);
+		#else
+		mem = (char*)aligned_alloc(64, bytes);
+		#endif
+		if (!mem) throw std::bad_alloc();
+		n = n_;
+
+		T *p = (T*)mem;
+		for (T *&q : U.plane)  { q = p + off; p += pitch; }
+		for (T *&q : U0.plane) { q = p + off; p += pitch; }
+		S *r = (S*)p;
+		g.x = r + goff; r += gpitch;
+		g.y = r + goff; r += gpitch;
+		g.z = r + goff;
+	}
+
+	/// Sets up the activity flags of U and U0 (see Field::active) for h rows of nb blocks, or removes them.
+	/// New flags are all set, which is always safe.
+	void track(bool on, bool reset, int h, int nb)
+	{
+		if (!on) { U.active = U0.active = NULL; return; }
+		const size_t m = (size_t)h * nb;
+		if (!reset && U.active && flags.size() == 2*m) return;
+		flags.assign(2*m, 1);
+		U.active  = flags.data();
+		U0.active = flags.data() + m;
+	}
+
+	/// Exchanges everything, including the plan
+	void swap(Wave &o)
+	{
+		std::swap(U, o.U); std::swap(U0, o.U0); std::swap(g, o.g);
+		std::swap(w, o.w); std::swap(h, o.h); std::swap(wrapped, o.wrapped);
+		std::swap(mem, o.mem); std::swap(n, o.n);
+		flags.swap(o.flags); // U.active and U0.active move along with the buffer
+		plan.swap(o.plan);
+	}
 
 	void clear()
 	{
-		std::vector<Point>().swap(U);
-		std::vector<Point>().swap(U0);
+		#ifdef _WINDOWS
+		_aligned_free(mem);
+		#else
+		free(mem);
+		#endif
+		mem = NULL; n = 0;
+		w = h = 0;
+		wrapped = false;
+		memset(&U,  0, sizeof(U));
+		memset(&U0, 0, sizeof(U0));
+		memset(&g,  0, sizeof(g));
+		flags.clear();
+		plan.reset();
 	}
+
+	std::unique_ptr<Plan<T>> plan; // see Graph::update
+
+private:
+	char  *mem; // all planes in one block
+	size_t n;
+	std::vector<uint8_t> flags; // for U.active and U0.active
 };
 
 Graph::Graph()
 : m_animating(false)
 , w(0), h(0)
+, gw(0), gh(0)
 , qz(2), tz(1)
+, blocking(true)
+, fused(true)
+, sparse(true)
+, quiet(0.0)
+, nthreads((int)std::thread::hardware_concurrency())
+, budget(0.0)
+, step_time(0.0), fixed_time(0.0)
+, sps(0.0)
 , frame((size_t)-1)
-, wave(new Wave)
-, rec(NULL)
+#ifdef SINGLE_PRECISION
+, single(true)
+#else
+, single(false)
+#endif
+, wave64(new Wave<double>)
+, wave32(new Wave<float>)
+, rec(NULL, NULL)
 { }
 
 Graph::~Graph()
 {
-	delete wave;
-	delete rec;
+	delete wave64;
+	delete wave32;
+}
+
+void Graph::resize(int w_, int h_)
+{
+	w = w_; h = h_;
 }
 
-void Graph::record(bool f)
+int Graph::downsampling() const
 {
-	if (!f && rec)
+	if (w <= 0 || h <= 0) return 1;
+	const int d = std::max((grid_w() + w - 1) / w, (grid_h() + h - 1) / h);
+	return std::max(1, std::min(d, Downsample::MAX_FACTOR));
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// update
+//----------------------------------------------------------------------------------------------------------------------
+#define BORDER Point::OVERLAP
+
+/**
+ * Copies row r (0 <= r < h, borders not counted) of F into the borders: its own left and right ends
+ * and, if it is close to the top or bottom, the border rows on the opposite side.
+ * Same as the "copy borders" layer, but for a single row, right after it was written.
+ */
+template<typename T> static inline void wrap_row(const Field<T> &F, int r, int w, int h, int W)
+{
+	#ifndef ZERO_BORDER
+	const size_t ow = BORDER * sizeof(T);
+	for (T *q : F.plane)
 	{
-		rec->finish();
-		delete rec; rec = NULL;
+		T *l = q + (BORDER + r)*W;
+		memcpy(l, l + w, ow);
+		memcpy(l + BORDER + w, l + BORDER, ow);
+		if (r >= h - BORDER) memcpy(q + (r + BORDER - h)*W, l, W * sizeof(T));
+		if (r < BORDER)      memcpy(q + (r + BORDER + h)*W, l, W * sizeof(T));
 	}
-	else if (f && !rec)
+	#endif
+}
+
+/**
+ * Rows i...i1-1 of to.U are bilinearly interpolated from from.U, which can have any other size. Both
+ * cover the same torus (or rectangle with ZERO_BORDER, where the outside is zero), so every point keeps
+ * its place in it. The metric is computed for the new grid like in Point::init. U0 only gets cleared,
+ * evolve writes it before anything reads it.
+ */
+template<typename T> static void resample(const Wave<T> &from, const Wave<T> &to, int i, int i1)
+{
+	const int w = to.w, h = to.h, W = Wave<T>::row_pitch(w);
+	const int ow = from.w, oh = from.h, OW = Wave<T>::row_pitch(ow);
+
+	const size_t rb = (size_t)W * (i1 - i) * sizeof(T);
+	for (T *q : to.U.plane)  memset(q + W*(BORDER+i), 0, rb);
+	for (T *q : to.U0.plane) memset(q + W*(BORDER+i), 0, rb);
+
+	// the point after a, which is in the zero border or wraps around
+	auto next = [](int a, int n)
 	{
-		rec = new Recorder;
+		#ifdef ZERO_BORDER
+		return a + 1;
+		#else
+		return (a + 1) % n;
+		#endif
+	};
+
+	// left and right neighbour in from and the weight of the right one, for every column of to
+	std::vector<int> c0(w), c1(w);
+	std::vector<T> fx(w);
+	for (int j = 0; j < w; ++j)
+	{
+		const double x = (double)j * ow / w;
+		c0[j] = std::min(ow - 1, (int)x);
+		c1[j] = next(c0[j], ow);
+		fx[j] = (T)(x - c0[j]);
+	}
+
+	Field<T> U = to.U;
+	Metric<T> g = to.g;
+	for (int r = i; r < i1; ++r)
+	{
+		const double y = (double)r * oh / h;
+		const int a = std::min(oh - 1, (int)y), b = next(a, oh);
+		const T fy = (T)(y - a);
+		const ptrdiff_t p = BORDER + (ptrdiff_t)W*(BORDER + r);
+		for (int k = 0; k < Field<T>::PLANES; ++k)
+		{
+			const T *A = from.U.plane[k] + BORDER + (ptrdiff_t)OW*(BORDER + a);
+			const T *B = from.U.plane[k] + BORDER + (ptrdiff_t)OW*(BORDER + b);
+			T *q = U.plane[k] + p;
+			for (int j = 0; j < w; ++j)
+			{
+				const T t = A[c0[j]] + (A[c1[j]] - A[c0[j]]) * fx[j];
+				const T u = B[c0[j]] + (B[c1[j]] - B[c0[j]]) * fx[j];
+				q[j] = t + (u - t) * fy;
+			}
+		}
+
+		const double gy = (double)(h - 2 * r) / (double)w;
+		for (int j = 0; j < w; ++j) Point::init_metric(g, p + j, (double)(w - 2 * j) / (double)w, gy);
+		wrap_row(U, r, w, h, W);
 	}
 }
 
-void Graph::viewport(int w_, int h_)
+/// Point::display for the n points starting at index i
+template<typename T> static inline void display_row(const Field<T> &F, ptrdiff_t i, int n, unsigned char *data)
 {
-	w = w_; h = h_;
-	glViewport(0, 0, w, h);
+	Kernels::display_row(F, i, n, data);
 }
 
-void Graph::draw() const
+/**
+ * Evolves a row and displays it in the same sweep, in pieces small enough to still be in L1
+ * when they get displayed. Only for the last step of a frame and if Point::display_local().
+ */
+template<typename T> static void evolve_display_row(Field<T> &F, const Field<T> &F0, const Metric<T> &g, ptrdiff_t i, int n, unsigned char *data)
 {
-	try
+	const int piece = 512;
+	for (; n > 0; n -= piece, i += piece, data += 4*piece)
 	{
-		update();
+		int m = std::min(n, piece);
+		Kernels::evolve_row(F, F0, g, i, m);
+		display_row(F, i, m, data);
 	}
-	catch (const std::bad_alloc &)
+}
+
+/**
+ * Evolving and displaying single rows r = 0...h-1 (borders not counted).
+ *
+ * If the fields have activity flags (Field::active), the rows are done in blocks of Field::TILE points.
+ * Blocks whose values are all within quiet of zero get set to exactly zero and their flag cleared.
+ * If nothing around a block is active in F0, its new value is zero as well, so evolve skips it (after
+ * clearing it once, if it was active before) and it displays as a single colour.
+ */
+template<typename T> struct Rows
+{
+	Metric<T> g;
+	int w, h, W; // grid size and row pitch
+	T quiet;     // threshold for the activity flags
+
+	ptrdiff_t start(int r) const { return BORDER + (ptrdiff_t)W*(BORDER + r); }
+	int blocks() const { return (w + Field<T>::TILE - 1) / Field<T>::TILE; }
+
+	/// Row r of F = evolve(F0). If data is set, it gets displayed too (for Point::display_local() only).
+	void evolve(Field<T> &F, const Field<T> &F0, int r, unsigned char *data) const
 	{
-		#ifdef DEBUG
-		std::cerr << "allocation failed!" << std::endl;
-		#endif
-		return;
+		const ptrdiff_t p = start(r);
+		if (!F.active)
+		{
+			if (data) evolve_display_row(F, F0, g, p, w, data); else Kernels::evolve_row(F, F0, g, p, w);
+			return;
+		}
+
+		const int nb = blocks(), L = Field<T>::TILE;
+		uint8_t *a = F.active + (size_t)r*nb;
+		for (int b = 0, x = 0; b < nb; ++b, x += L)
+		{
+			const int n = std::min(L, w - x);
+			if (near_active(F0, r, b))
+			{
+				Kernels::evolve_row(F, F0, g, p + x, n);
+				a[b] = !F.quiet(p + x, n, quiet);
+				if (!a[b]) F.clear(p + x, n);
+			}
+			else if (a[b])
+			{
+				F.clear(p + x, n);
+				a[b] = 0;
+			}
+			if (data) display_block(F, p + x, n, data + 4*x, a[b]);
+		}
 	}
-	catch (...)
+
+	/// Displays row r of F
+	void display(const Field<T> &F, int r, unsigned char *data) const
 	{
-		#ifdef DEBUG
-		std::cerr << "exception in update()!" << std::endl;
-		#endif
-		return;
+		const ptrdiff_t p = start(r);
+		if (!F.active)
+		{
+			display_row(F, p, w, data);
+			return;
+		}
+
+		// a block without its flag is all zero, which is all a local display looks at. The flags of the
+		// rows around belong to other chunks, whose evolve units can still be running.
+		const int nb = blocks(), L = Field<T>::TILE;
+		const bool local = Point::display_local();
+		const uint8_t *a = F.active + (size_t)r*nb;
+		for (int b = 0, x = 0; b < nb; ++b, x += L)
+		{
+			display_block(F, p + x, std::min(L, w - x), data + 4*x, local ? a[b] != 0 : near_active(F, r, b));
+		}
 	}
-	if (im.empty()) return;
-
-	glMatrixMode(GL_PROJECTION);
-	glLoadIdentity();
-	glOrtho(0.0, 1.0, 0.0, 1.0, -1.0, 1.0);
-	glMatrixMode(GL_MODELVIEW);
-	glLoadIdentity();
-
-	GL_CHECK;
-	glPixelZoom((GLfloat)w / im.w(), (GLfloat)h / im.h());
-	glRasterPos2i(0, 0);
-	glDrawPixels(im.w(), im.h(), GL_RGBA, GL_UNSIGNED_BYTE, im.data().data());
-	glPixelZoom(1, 1);
-	GL_CHECK;
-
-	if (rec) rec->add(im);
-}
 
-//----------------------------------------------------------------------------------------------------------------------
-// update and draw
-//----------------------------------------------------------------------------------------------------------------------
-#define BORDER Point::OVERLAP
+private:
+	/// Is block b of row r or any of its neighbours active in F?
+	bool near_active(const Field<T> &F, int r, int b) const
+	{
+		const int nb = blocks();
+		for (int y = r - BORDER; y <= r + BORDER; ++y)
+		{
+			#ifdef ZERO_BORDER
+			if (y < 0 || y >= h) continue;
+			const uint8_t *a = F.active + (size_t)y*nb;
+			if ((b > 0 && a[b-1]) || a[b] || (b+1 < nb && a[b+1])) return true;
+			#else
+			const uint8_t *a = F.active + (size_t)((y + h) % h)*nb;
+			if (a[(b + nb - 1) % nb] || a[b] || a[(b + 1) % nb]) return true;
+			#endif
+		}
+		return false;
+	}
+
+	/// Inactive blocks and their surroundings are zero, so all points look like the first one
+	static void display_block(const Field<T> &F, ptrdiff_t i, int n, unsigned char *data, bool active)
+	{
+		if (active)
+		{
+			display_row(F, i, n, data);
+			return;
+		}
+		display_row(F, i, 1, data);
+		for (int j = 1; j < n; ++j) memcpy(data + 4*j, data, 4);
+	}
+};
+
+/**
+ * Everything that changes from one frame to the next. The cached task graph (Plan) reads it instead
+ * of having it captured in its units.
+ */
+template<typename T> struct Frame
+{
+	Field<T> F[2];        // F[0] = U = the state before the frame, F[1] = U0
+	unsigned char *data;  // the image, grid sized
+	unsigned char *image; // data downsampled for Graph::image(), if that is not data itself
+};
+
+/**
+ * Temporal blocking: k steps are done strip by strip instead of sweeping the whole grid k times.
+ * Step s = 1...k reads X[s-1] and writes X[s] (modulo 2), so X[0] holds the state before and X[k] after.
+ *
+ * Every strip [a,b) loses BORDER rows on both sides per step (an upright trapezoid), so the strips
+ * do not need each other. What is left are the triangles around the strip boundaries, which grow
+ * by BORDER rows per step (inverted trapezoids) and can run as soon as both adjacent strips are done.
+ * Inside a trapezoid, the steps run as a skewed wavefront (step s trails step 1 by s-1 rows), which
+ * keeps only a few rows of either buffer in use at a time, so they stay in cache between the steps.
+ *
+ * Strips need at least 2*(k-1)*BORDER rows and evolve() must not write into its neighbours.
+ * Every step wraps the rows it writes, so the borders of X[0] have to be current too (Wave::wrapped).
+ */
+template<typename T> struct Trapezoid
+{
+	Frame<T> *f;  // X[i] = f->F[(p+i) & 1]
+	int       p;
+	Rows<T>   rows;
+	int  k;       // number of steps
+	bool display; // display the rows of step k into f->data
+
+	void upright (int a, int b) const { run(a, b, +1, a, b); }
+	void inverted(int c)        const { run(c, c, -1, c, c + 2*(k-1)*BORDER); }
+
+private:
+	// rows lo+d*o ... hi-d*o-1 of step s (o = (s-1)*BORDER) run at front f = row+o, for fronts f0...f1-1
+	void run(int lo, int hi, int d, int f0, int f1) const
+	{
+		const int h = rows.h;
+		for (int f = f0; f < f1; ++f)
+		{
+			for (int s = 1, o = 0; s <= k; ++s, o += BORDER)
+			{
+				int r = f - o;
+				if (r < lo + d*o || r >= hi - d*o) continue;
+				step(s, (r + h) % h); // the triangle at c = 0 wraps around
+			}
+		}
+	}
+
+	void step(int s, int r) const
+	{
+		Field<T> &F = f->F[(p + s) & 1];
+		rows.evolve(F, f->F[(p + s - 1) & 1], r, s == k && display ? f->data + 4*(ptrdiff_t)rows.w*r : NULL);
+		wrap_row(F, r, rows.w, rows.h, rows.W);
+	}
+};
+
+/**
+ * The task graph for the frames after the first, which only gets built again when the settings it
+ * depends on (the Key) change. Every frame only has to set the frame parameters and rerun the task.
+ */
+template<typename T> struct Plan
+{
+	typedef std::tuple<int, int, int, int, bool, bool, bool, bool, T, int> Key; // w, h, tz, nthreads, blocked, fuse, local, tracked, quiet, downsampling
+	Key      key;
+	Task     task;
+	Frame<T> frame;
+	std::vector<WorkLayer*> shown; // the layers that run once per frame, all others run once per step
+};
 
 void Graph::update() const
 {
-	static int nthreads = (int)std::thread::hardware_concurrency();
-	int w = this->w / qz, h = this->h / qz;
+	if (single)
+	{
+		wave64->clear();
+		update(*wave32);
+	}
+	else
+	{
+		wave32->clear();
+		update(*wave64);
+	}
+}
+
+template<typename T> void Graph::update(Wave<T> &wave) const
+{
+	const int w = grid_w(), h = grid_h(), d = downsampling();
 
 	//------------------------------------------------------------------------------------------------------------------
 	// (1) setup the info structs
 	//------------------------------------------------------------------------------------------------------------------
 
-	Task task;
+	Task local, *task = &local; // the frames after the first run the cached wave.plan->task
+	Wave<T> old; // the state before a size change, see resample
 	WorkLayer *layer = NULL;
 
-	const int W = w + 2 * BORDER;
+	const int W = Wave<T>::row_pitch(w);
 	const int chunk = std::max(1, h / (2*nthreads));
 	const int space = (BORDER + chunk - 1) / chunk;
+	const bool blocked = blocking && Point::MOD_OVERLAP == 0; // see Trapezoid
+	const bool tracked = sparse && Point::MOD_OVERLAP == 0; // see Rows
 	Point::Y = W;
 
 	//------------------------------------------------------------------------------------------------------------------
 	// (2) calculation
 	//------------------------------------------------------------------------------------------------------------------
 
-	unsigned char *data = NULL;
-	Point *ud = NULL;
-	Point *ud0 = NULL;
+	unsigned char *data = NULL, *image = NULL; // see Frame
+	bool fuse = false; // display in the last evolve step, no visualize layer
+	bool build = true; // the task needs its layers, false if the cached one is reused
+	int  fin = 0;      // the state after the frame is in f->F[fin]
+	Frame<T> local_frame, *f = &local_frame;
+	Metric<T> g;
+	Rows<T> rows{Metric<T>(), w, h, W, (T)quiet}; // g is set below
 
-	assert(wave->U.size() == wave->U0.size());
+	// display into im, or into full and box filter that into im
+	auto images = [&]()
+	{
+		if (d == 1) { full.clear(); data = image = im.redim(w, h); return; }
+		image = im.redim(Downsample::size(w, d), Downsample::size(h, d));
+		data = full.redim(w, h);
+	};
 
 	++frame;
-	if (frame == 0 || (int)im.w() != w || (int)im.h() != h)
+	if (frame == 0 || wave.w != w || wave.h != h || !wave.size())
 	{
-		// initial setup
+		// initial setup, or only a new size for the current state
 		if (h < BORDER || w < BORDER)
 		{
 			im.redim(0, 0);
-			wave->clear();
+			full.clear();
+			wave.clear();
 			return;
 		}
+		if (frame != 0 && wave.size()) old.swap(wave);
 		try
 		{
-			data = im.redim(w, h);
-			size_t n = ((size_t)w + 2 * BORDER)*((size_t)h + 2 * BORDER);
-			wave->U.resize(n);
-			wave->U0.resize(n);
+			images();
+			wave.resize((size_t)W*((size_t)h + 2 * BORDER));
+			wave.w = w; wave.h = h;
 		}
 		catch (...)
 		{
 			im.redim(0, 0);
-			wave->clear();
+			full.clear();
+			wave.clear();
+			wave.swap(old); // keep it for the next try
 		}
 		if (im.empty()) return;
+		wave.track(tracked, true, h, rows.blocks());
+		wave.plan.reset();
+
+		#ifdef ZERO_BORDER
+		// evolve() never writes the borders, so they stay zero from here on (the init units clear the rest)
+		for (T *q : wave.U.plane)  { memset(q, 0, W*BORDER * sizeof(T)); memset(q + W*(BORDER+h), 0, W*BORDER * sizeof(T)); }
+		for (T *q : wave.U0.plane) { memset(q, 0, W*BORDER * sizeof(T)); memset(q + W*(BORDER+h), 0, W*BORDER * sizeof(T)); }
+		#endif
 
-		ud = wave->U.data();
-		ud0 = wave->U0.data();
+		g = rows.g = wave.g;
 
-		layer = new WorkLayer("init", &task, NULL);
-		Point *p = ud + BORDER + W*BORDER;
+		// every unit clears its rows of U and U0 first, so their pages get first touched by the
+		// thread (and with Task::pin_threads, the node) that evolves them later on
+		const Wave<T> *wv = &wave, *ov = &old;
+		const bool keep = old.size() != 0;
+		layer = new WorkLayer(keep ? "resample" : "init", task, NULL);
+		ptrdiff_t p = BORDER + W*BORDER;
 		double hr = (double)h / (double)w;
 		for (int i = 0; i < h; i += chunk)
 		{
 			int i1 = std::min(h, i + chunk);
-			layer->add_unit([=]() mutable
+			if (keep) layer->add_unit([=]() { resample(*ov, *wv, i, i1); });
+			else layer->add_unit([=]() mutable
 			{
+				const size_t rb = (size_t)W * (i1 - i) * sizeof(T);
+				for (T *q : wv->U.plane)  memset(q + W*(BORDER+i), 0, rb);
+				for (T *q : wv->U0.plane) memset(q + W*(BORDER+i), 0, rb);
+
+				Field<T> ud = wv->U;
 				for (; i < i1; ++i)
 				{
 					double y = (double)(h - 2 * i) / (double)w;
 					for (int j = 0; j < w; ++j, ++p)
 					{
 						double x = (double)(w - 2 * j) / (double)w;
-						p->init(x, y, hr);
+						Point::init(ud, g, p, x, y, hr);
 					}
-					p += 2 * BORDER;
+					p += W - w;
+					wrap_row(ud, i, w, h, W); // for the blocked steps, which expect it
 				}
 			});
 			p += W*chunk;
@@ -173,104 +555,161 @@ void Graph::update() const
 	}
 	else
 	{
-		data = im.redim(w, h);
+		images();
+		wave.track(tracked, false, h, rows.blocks());
+		g = rows.g = wave.g;
+		fin = tz & 1;
+
+		// the unblocked steps copy the borders of U0 before they read it, the blocked ones need them in U
+		if (blocked && !wave.wrapped) for (int r = 0; r < h; ++r) wrap_row(wave.U, r, w, h, W);
+
+		// the last evolve step can display its rows right away, as long as they are final when
+		// written and the current visualization does not need the neighbours
+		fuse = fused && Point::MOD_OVERLAP == 0 && Point::display_local();
+
+		// the metric only changes in the initial setup, which drops the plan, and display_local
+		// decides what the visualize layer waits for (see below)
+		typename Plan<T>::Key key(w, h, tz, nthreads, blocked, fuse, Point::display_local(), tracked, rows.quiet, d);
+		build = !wave.plan || wave.plan->key != key;
+		if (build)
+		{
+			wave.plan.reset(new Plan<T>);
+			wave.plan->key = key;
+		}
+		task = &wave.plan->task;
+		f = &wave.plan->frame;
 
-		ud = wave->U.data();
-		ud0 = wave->U0.data();
+		// without build, the cached task gets reused as it is
+		if (build && blocked)
+		{
+			// strips of almost equal height, one per unit, boundary j is at the top of strip j
+			const int n = (h + chunk - 1) / chunk;
+			auto strip = [n,h](int j) { return (int)((long long)j * h / n); };
+			const int kmax = 1 + h / n / (2*BORDER);
+
+			Trapezoid<T> tr{f, 0, rows, 1, false};
+			for (int t = 0; t < tz; t += tr.k)
+			{
+				tr.k = std::min(kmax, tz - t);
+				tr.display = fuse && t + tr.k == tz;
+
+				// strip j needs the triangles at both of its ends from the last round
+				layer = new WorkLayer("evolve strips", task, layer, 0, 2, 0);
+				layer->set_cyclic();
+				for (int j = 0; j < n; ++j)
+				{
+					int a = strip(j), b = strip(j + 1);
+					layer->add_unit([=]() { tr.upright(a, b); });
+				}
 
-		for (int t = 0; t < tz; ++t)
+				// the triangle at boundary j needs strips j-1 and j
+				layer = new WorkLayer("evolve strip boundaries", task, layer, 0, 2, -1);
+				layer->set_cyclic();
+				for (int j = 0; j < n; ++j)
+				{
+					int c = strip(j);
+					layer->add_unit([=]() { tr.inverted(c); });
+				}
+
+				if (tr.k & 1) tr.p ^= 1;
+			}
+		}
+		else if (build) for (int t = 0; t < tz; ++t)
 		{
-			std::swap(ud, ud0);
+			Field<T> *U = &f->F[(t+1) & 1], *U0 = &f->F[t & 1]; // step t goes from U0 to U
 
 			// U is the flat torus with BORDER points glued together
 			// To avoid tons of modulo operations, we add BORDER-sized
 			// borders on every side - the copying below is what buys 
 			// the simpler evolve()
 
+			// evolve() stores its results unless MOD_OVERLAP > 0, where it accumulates
+			// into U, which then has to be cleared first
+			constexpr bool prepare = Point::MOD_OVERLAP > 0;
+
 			#ifdef ZERO_BORDER
-			layer = new WorkLayer("prepare", &task, layer, 0, -1);
+			if (prepare)
 			{
+				layer = new WorkLayer("prepare", task, layer, 0, -1);
 				layer->add_unit([=]()
 				{
-					memset(ud, 0, BORDER * W * sizeof(Point));
-					memset(ud + (BORDER + h)*W, 0, BORDER * W * sizeof(Point));
+					for (T *q : U->plane)
+					{
+						memset(q, 0, BORDER * W * sizeof(T));
+						memset(q + (BORDER + h)*W, 0, BORDER * W * sizeof(T));
+					}
 				});
-				Point *p = ud + W*BORDER;
+				ptrdiff_t p = W*BORDER;
 				for (int i = 0; i < h; i += chunk)
 				{
 					int i1 = std::min(h, i + chunk);
 					layer->add_unit([=]()
 					{
-						memset(p, 0, (i1 - i) * W * sizeof(Point));
+						for (T *q : U->plane) memset(q + p, 0, (i1 - i) * W * sizeof(T));
 					});
 					p += W*chunk;
 				}
 			}
+			const bool striped = (prepare || t > 0); // is the layer below split into the same chunks?
 			#else
 			{
-				Point * const d = ud0;
-				size_t ow = BORDER * sizeof(Point);
-				layer = new WorkLayer("copy borders in U0", &task, layer, 0, -1);
-				layer->add_unit([=]() { memcpy(d, d + h*W, W * ow); }); // top
-				layer->add_unit([=]() { memcpy(d + (BORDER + h)*W, d + BORDER*W, W * ow); }); // bottom
+				size_t ow = BORDER * sizeof(T);
+				layer = new WorkLayer("copy borders in U0", task, layer, 0, -1);
+				layer->add_unit([=]() { for (T *q : U0->plane) memcpy(q, q + h*W, W * ow); }); // top
+				layer->add_unit([=]() { for (T *q : U0->plane) memcpy(q + (BORDER + h)*W, q + BORDER*W, W * ow); }); // bottom
 				layer->add_unit([=]() { // left and right
-					Point *l = d + BORDER*W;
-					for (int y = 0; y < h; ++y, l += W)
+					for (T *q : U0->plane)
 					{
-						memcpy(l, l + w, ow);
-						memcpy(l + BORDER + w, l + BORDER, ow);
+						T *l = q + BORDER*W;
+						for (int y = 0; y < h; ++y, l += W)
+						{
+							memcpy(l, l + w, ow);
+							memcpy(l + BORDER + w, l + BORDER, ow);
+						}
 					}
 				});
 			}
 
-			layer = new WorkLayer("prepare", &task, layer, 0, -1);
+			if (prepare)
 			{
-				if (Point::MOD_OVERLAP > 0)
+				layer = new WorkLayer("prepare", task, layer, 0, -1);
+
+				// need to clear even the borders because they will be added later
+				layer->add_unit([=]()
 				{
-					// need to clear even the borders because they will be added later
-					layer->add_unit([=]()
+					for (T *q : U->plane)
 					{
-						memset(ud,              0, BORDER * W * sizeof(Point));
-						memset(ud+(BORDER+h)*W, 0, BORDER * W * sizeof(Point));
-					});
+						memset(q,              0, BORDER * W * sizeof(T));
+						memset(q+(BORDER+h)*W, 0, BORDER * W * sizeof(T));
+					}
+				});
 
-					// add a new layer so its striping can match the one below 
-					layer = new WorkLayer("prepare2", &task, layer, 0, -1);
-				}
-				Point *p = ud + W*BORDER;
+				// add a new layer so its striping can match the one below 
+				layer = new WorkLayer("prepare2", task, layer, 0, -1);
+				ptrdiff_t p = W*BORDER;
 				for (int i = 0; i < h; i += chunk)
 				{
 					int i1 = std::min(h, i + chunk);
 					layer->add_unit([=]()
 					{
-						memset(p, 0, (i1 - i) * W * sizeof(Point));
+						for (T *q : U->plane) memset(q + p, 0, (i1 - i) * W * sizeof(T));
 					});
 					p += W*chunk;
 				}
 			}
+			const bool striped = prepare;
 			#endif
-			layer = new WorkLayer("evolve", &task, layer, space, 2*space+1, -space);
+			layer = new WorkLayer("evolve", task, layer, space, striped ? 2*space+1 : -1, -space);
 			layer->set_cyclic();
 			{
-				Point *p = ud + BORDER + W*BORDER;
-				Point *p0 = ud0 + BORDER + W*BORDER;
+				const bool show = fuse && t == tz-1;
 				for (int i = 0; i < h; i += chunk)
 				{
 					int i1 = std::min(h, i + chunk);
-					layer->add_unit([=]() mutable
+					layer->add_unit([=]()
 					{
-						for (; i < i1; ++i)
-						{
-							for (auto *end = p + w; p != end; ++p, ++p0)
-							{
-								p->evolve(p0);
-							}
-							p += 2 * BORDER;
-							p0 += 2 * BORDER;
-						}
+						for (int r = i; r < i1; ++r) rows.evolve(*U, *U0, r, show ? f->data + 4*(ptrdiff_t)w*r : NULL);
 					});
-					p += W*chunk;
-					p0 += W*chunk;
 				}
 			}
 
@@ -280,66 +719,175 @@ void Graph::update() const
 			{
 				// add border modification back to their original location
 				assert(m <= BORDER);
-				layer = new WorkLayer("copy borders in U", &task, layer, 1, -1);
+				layer = new WorkLayer("copy borders in U", task, layer, 1, -1);
 				layer->add_unit([=]() // top
 				{
+					for (T *r : U->plane)
 					for (int i = BORDER-m; i < BORDER; ++i)
 					{
-						Point *p = ud + i*W;
-						Point *q = ud + (i+h)*W;
+						T *p = r + i*W;
+						T *q = r + (i+h)*W;
 						for (int j = 0; j < W; ++j) *q++ += *p++;
 					}
 				});
 
 				// layer->space == 1 => next one is executed after the others are done
 				layer->add_unit([=]() { // left and right
-					Point *p = ud + BORDER*W;
-					for (int y = 0; y < h; ++y, p += W)
+					for (T *r : U->plane)
 					{
-						for (int x = 0; x < m; ++x)
+						T *p = r + BORDER*W;
+						for (int y = 0; y < h; ++y, p += W)
 						{
-							p[BORDER + x] += p[BORDER + w + x];
-							p[BORDER - 1 + w - x] += p[BORDER - 1 - x];
+							for (int x = 0; x < m; ++x)
+							{
+								p[BORDER + x] += p[BORDER + w + x];
+								p[BORDER - 1 + w - x] += p[BORDER - 1 - x];
+							}
 						}
 					}
 				});
 
 				layer->add_unit([=]() // bottom
 				{
-					Point *p = ud + (BORDER + h)*W;
-					Point *q = ud +  BORDER*W;
-					for (int i = 0; i < m; ++i)
+					for (T *r : U->plane)
 					{
-						for (int j = 0; j < W; ++j) *q++ += *p++;
+						T *p = r + (BORDER + h)*W;
+						T *q = r +  BORDER*W;
+						for (int i = 0; i < m; ++i)
+						{
+							for (int j = 0; j < W; ++j) *q++ += *p++;
+						}
 					}
 				});
 			}
 			#endif
 		}
 
-		if (tz & 1) wave->U.swap(wave->U0);
 	}
 
-	layer = new WorkLayer("visualize", &task, layer, 0, 1);
-	Point *p = ud + BORDER + W*BORDER;
-	for (int i = 0; i < h; i += chunk)
+	f->F[0] = wave.U;
+	f->F[1] = wave.U0;
+	f->data = data;
+	f->image = image;
+
+	if (build && !fuse)
 	{
-		int i1 = std::min(h, i + chunk);
-		layer->add_unit([=]() mutable
+		// strips and chunks differ, and if display reads the neighbouring rows, it needs the chunks around it
+		if (blocked) layer = new WorkLayer("visualize", task, layer, 0, -1);
+		else if (Point::display_local()) layer = new WorkLayer("visualize", task, layer, 0, 1);
+		else
 		{
-			for (; i < i1; ++i)
+			layer = new WorkLayer("visualize", task, layer, 0, 3, -1);
+			layer->set_cyclic();
+		}
+		for (int i = 0; i < h; i += chunk)
+		{
+			int i1 = std::min(h, i + chunk);
+			layer->add_unit([=]() // no mutable captures, the units run again in later frames
 			{
-				for (auto *end = p+w; p != end; ++p, data += 4)
-				{
-					p->display(data);
-				}
-				p += 2 * BORDER;
-			}
-		});
-		data += 4 * w * chunk;
-		p += W*chunk;
+				for (int r = i; r < i1; ++r) rows.display(f->F[fin], r, f->data + 4*(ptrdiff_t)w*r);
+			});
+		}
+		if (wave.plan) wave.plan->shown.push_back(layer);
+	}
+
+	if (build && d > 1)
+	{
+		// every row of the result needs d rows of the image, which do not line up with the chunks
+		layer = new WorkLayer("downsample", task, layer, 0, -1);
+		const int dh = Downsample::size(h, d), dchunk = std::max(1, dh / (2*nthreads));
+		for (int y = 0; y < dh; y += dchunk)
+		{
+			int y1 = std::min(dh, y + dchunk);
+			layer->add_unit([=]() { Downsample::rows(f->data, w, h, d, f->image, y, y1); });
+		}
+		if (wave.plan) wave.plan->shown.push_back(layer);
 	}
 
-	task.run(nthreads);
+	const bool evolve = f != &local_frame; // the initial setup does not count for the timing
+	if (evolve) task->time_layers(budget > 0.0);
+	const auto t0 = std::chrono::steady_clock::now();
+
+	task->run(nthreads);
+	if (fin) std::swap(wave.U, wave.U0);
+	wave.wrapped = blocked || !evolve; // init and resample wrap every row
+
+	if (!evolve) return;
+	const double dt = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+	double shown = 0.0;
+	for (const WorkLayer *l : wave.plan->shown) shown += l->busy();
+	adapt(dt, task->busy(), shown);
 }
 
+/**
+ * Splits the time dt of the last frame into the part that grows with tz and the rest (visualize and
+ * downsample), in proportion to how busy their layers were, and keeps running averages of both. With
+ * auto_timezoom, tz then becomes the number of steps that fit into the budget. Every new tz rebuilds
+ * the plan, so small changes are ignored and tz at most doubles per frame.
+ */
+void Graph::adapt(double dt, double busy, double shown) const
+{
+	if (dt <= 0.0) return;
+	const double a = 0.25; // weight of the last frame in the averages
+	const double s = busy > 0.0 ? shown / busy : 0.0;
+	const double step = dt * (1.0 - s) / tz, fixed = dt * s;
+	step_time  = step_time > 0.0 ? step_time + a * (step - step_time) : step;
+	fixed_time = fixed_time + a * (fixed - fixed_time);
+	sps = sps > 0.0 ? sps + a * (tz / dt - sps) : tz / dt;
+
+	if (budget <= 0.0 || step_time <= 0.0) return;
+	const double n = (budget - fixed_time) / step_time;
+	const int k = n < 1.0 ? 1 : n > 2.0 * tz ? 2 * tz : (int)n;
+	if (std::abs(k - tz) >= std::max(1, tz / 10)) tz = k;
+}
+
+std::string Graph::numa_report() const
+{
+	return single ? numa_report(*wave32) : numa_report(*wave64);
+}
+
+template<typename T> std::string Graph::numa_report(const Wave<T> &wave) const
+{
+	const int w = wave.w, h = wave.h;
+	if (!wave.size() || !w || !h) return "Nothing allocated";
+
+	// which node should have the pages of row r? Same chunks as in update.
+	const int W = Wave<T>::row_pitch(w);
+	const int chunk = std::max(1, h / (2*nthreads)), n = (h + chunk - 1) / chunk;
+	const bool pinned = Task::pinned_threads();
+
+	size_t total = 0, untouched = 0, local = 0, remote = 0;
+	std::vector<size_t> per_node(Numa::nodes(), 0);
+	std::vector<int> nodes;
+	auto count = [&](const void *base, size_t elem)
+	{
+		const size_t ps = Numa::page_size(), rb = W * elem;
+		const char *p = (const char*)base + BORDER * rb;
+		const uintptr_t p0 = (uintptr_t)p & ~(uintptr_t)(ps-1);
+		total += Numa::page_nodes(p, h * rb, nodes);
+		for (size_t k = 0; k < nodes.size(); ++k)
+		{
+			int node = nodes[k];
+			if (node < 0) { ++untouched; continue; }
+			if (node < (int)per_node.size()) ++per_node[node];
+			ptrdiff_t mid = (ptrdiff_t)(p0 + k*ps + ps/2) - (ptrdiff_t)p;
+			int r = std::max(0, std::min(h-1, (int)(mid / (ptrdiff_t)rb)));
+			int home = Task::home_node(r / chunk, n, nthreads);
+			if (home < 0) continue;
+			if (home == node) ++local; else ++remote;
+		}
+	};
+	for (const T *q : wave.U.plane)  count(q, sizeof(T));
+	for (const T *q : wave.U0.plane) count(q, sizeof(T));
+	count(wave.g.x, sizeof(*wave.g.x));
+	count(wave.g.y, sizeof(*wave.g.y));
+	count(wave.g.z, sizeof(*wave.g.z));
+
+	std::ostringstream os;
+	os << total << " pages in U, U0 and the metric";
+	for (size_t k = 0; k < per_node.size(); ++k) os << ", node " << k << ": " << per_node[k];
+	os << ", unknown: " << untouched;
+	if (pinned) os << " - " << local << " local, " << remote << " remote";
+	else os << " - threads are not pinned";
+	return os.str();
+}
@@ -1,6 +1,8 @@
 #pragma once
 #include "Graphs/GL_Image.h"
+#include <memory>
 class Recorder;
+template<typename T> struct Wave;
 
 class Graph
 {
@@ -12,29 +14,88 @@ public:
 	void animate(bool f) { m_animating = f; }
 	void reset() { frame = (size_t)-1; } // start animation at t=0 again
 
-	bool recording() const { return rec; }
+	// window side (GraphView.cc), the only part that needs GL
+	bool recording() const { return rec != nullptr; }
 	void record(bool f);
+	void record_frame() const; // adds image() to the recording, if there is one
 
-	void viewport(int w, int h);
+	static void draw(const GL_Image &im, int w, int h); // draws im (one of our images) into a w x h viewport
+	static bool texture_upload(); // draw through a GL_Stream instead of glDrawPixels, if GL can (the default). GL thread only.
+	static void texture_upload(bool f);
+
+	// simulation side (Graph.cc)
+	void resize(int w, int h); // the window, the simulation is w/zoom x h/zoom unless grid() is set
 	int  screen_w() const { return w; }
 	int  screen_h() const { return h; }
 
-	void draw() const;
+	/// Simulation size independent of the window, 0x0 goes back to w/zoom x h/zoom
+	void grid(int w, int h) { gw = w; gh = h; if (gw <= 0 || gh <= 0) gw = gh = 0; }
+	int  grid_w() const { return gw ? gw : w / qz; }
+	int  grid_h() const { return gh ? gh : h / qz; }
+
+	/// Grids larger than the window get box filtered by this factor for image(), see Downsample
+	int  downsampling() const;
+
+	/// Evolves by timezoom steps and displays into image(). The first call and every one after
+	/// reset() or a grid size change sets up the initial state instead.
+	void update() const;
+	const GL_Image &image() const { return im; }
+	void swap_image(GL_Image &x) const { im.swap(x); } // hands image() over without copying, update does not need it back
+
+	int  threads() const { return nthreads; }
+	void threads(int n) { nthreads = n > 0 ? n : (int)std::thread::hardware_concurrency(); } // n <= 0: one per core
 
 	int  zoom() const { return qz; }
 	void zoom(int z) { qz = z; if (qz < 1) qz = 1; }
 	int  timezoom() const { return tz; }
 	void timezoom(int z) { tz = z; if (tz < 1) tz = 1; }
 
+	/// Automatic timezoom: as many steps per frame as fit into budget seconds (0 turns it off)
+	double auto_timezoom() const { return budget; }
+	void auto_timezoom(double seconds) { budget = seconds > 0.0 ? seconds : 0.0; }
+	double steps_per_second() const { return sps; } ///< Averaged over the last frames
+
+	bool temporal_blocking() const { return blocking; }
+	void temporal_blocking(bool f) { blocking = f; }
+
+	bool fused_display() const { return fused; }
+	void fused_display(bool f) { fused = f; }
+
+	bool sparse_tracking() const { return sparse; }
+	void sparse_tracking(bool f) { sparse = f; }
+	double quiet_threshold() const { return quiet; }
+	void quiet_threshold(double q) { quiet = q > 0.0 ? q : 0.0; }
+
+	/// Where the pages of the simulation are: per NUMA node and, with Task::pin_threads, how many of
+	/// them are on the node of the thread that works on them
+	std::string numa_report() const;
+
+	bool single_precision() const { return single; }
+	void single_precision(bool f) { if (f != single) { single = f; reset(); } } // restarts the animation
+
 private:
-	void update() const;
+	template<typename T> void update(Wave<T> &wave) const;
+	template<typename T> std::string numa_report(const Wave<T> &wave) const;
+	void adapt(double dt, double busy, double shown) const;
 
 	bool m_animating;
-	int  qz; // quality reduction factor: generated image is w/qz x h/qz
-	int  tz; // speedup factor: compute tz iterations per frame
+	int  qz; // quality reduction factor: generated image is w/qz x h/qz (unless gw is set)
+	mutable int tz; // speedup factor: compute tz iterations per frame (set by adapt for auto_timezoom)
 	int  w, h;
-	Recorder *rec;
+	int  gw, gh; // grid(), 0 to follow the window
+	bool single; // simulate in float instead of double
+	bool blocking; // do the tz steps strip by strip, see Trapezoid in Graph.cc
+	bool fused; // display every row of the last step right after evolving it instead of in a separate pass
+	bool sparse; // skip blocks that are zero and have no active neighbours, see Rows in Graph.cc
+	double quiet; // blocks within quiet of zero count as zero (and get set to zero)
+	int nthreads;
+	double budget; // auto_timezoom, 0 for off
+	mutable double step_time, fixed_time; // estimated seconds per evolve step and for the rest of a frame
+	mutable double sps; // steps_per_second
+	std::unique_ptr<Recorder, void (*)(Recorder *)> rec; // deleted by GraphView.cc, which creates it
 	mutable GL_Image im;
-	mutable struct Wave *wave;
+	mutable GL_Image full; // the grid sized image if it gets downsampled into im
+	mutable Wave<double> *wave64;
+	mutable Wave<float>  *wave32; // only one of them is used at any time
 	mutable size_t frame;
 };
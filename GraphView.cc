@@ -0,0 +1,58 @@
+#include "Graph.h"
+#include "Graphs/GL_Stream.h"
+#include "Graphs/GL_Util.h"
+#include "Utility/Recorder.h"
+#include <GL/gl.h>
+
+void Graph::record(bool f)
+{
+	if (!f && rec)
+	{
+		rec->finish();
+		rec.reset();
+	}
+	else if (f && !rec)
+	{
+		rec = std::unique_ptr<Recorder, void (*)(Recorder *)>(new Recorder, [](Recorder *r) { delete r; });
+	}
+}
+
+void Graph::record_frame() const
+{
+	if (rec && !im.empty()) rec->add(im);
+}
+
+static bool use_stream = true;
+static GL_Stream *stream = NULL; // created with the first draw and kept as long as the context
+
+bool Graph::texture_upload() { return use_stream; }
+void Graph::texture_upload(bool f) { use_stream = f; }
+
+void Graph::draw(const GL_Image &im, int w, int h)
+{
+	if (im.empty()) return;
+
+	if (use_stream)
+	{
+		static const bool supported = GL_Stream::supported();
+		if (supported)
+		{
+			if (!stream) stream = new GL_Stream;
+			stream->draw(im);
+			return;
+		}
+	}
+
+	glMatrixMode(GL_PROJECTION);
+	glLoadIdentity();
+	glOrtho(0.0, 1.0, 0.0, 1.0, -1.0, 1.0);
+	glMatrixMode(GL_MODELVIEW);
+	glLoadIdentity();
+
+	GL_CHECK;
+	glPixelZoom((GLfloat)w / im.w(), (GLfloat)h / im.h());
+	glRasterPos2i(0, 0);
+	glDrawPixels(im.w(), im.h(), GL_RGBA, GL_UNSIGNED_BYTE, im.data().data());
+	glPixelZoom(1, 1);
+	GL_CHECK;
+}
@@ -0,0 +1,82 @@
+#include "Downsample.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define HAVE_SSE2 // part of x86-64, so no need for the runtime selection of Kernels
+#include <emmintrin.h>
+#endif
+
+/// acc[k] (+)= src[k] for k < n, sets instead of adding for the first row of a block
+static void add_row(uint16_t *acc, const unsigned char *src, size_t n, bool first)
+{
+	size_t k = 0;
+	#ifdef HAVE_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	for (; k + 16 <= n; k += 16)
+	{
+		__m128i s = _mm_loadu_si128((const __m128i*)(src + k));
+		__m128i lo = _mm_unpacklo_epi8(s, zero), hi = _mm_unpackhi_epi8(s, zero);
+		if (!first)
+		{
+			lo = _mm_add_epi16(lo, _mm_loadu_si128((const __m128i*)(acc + k)));
+			hi = _mm_add_epi16(hi, _mm_loadu_si128((const __m128i*)(acc + k + 8)));
+		}
+		_mm_storeu_si128((__m128i*)(acc + k),     lo);
+		_mm_storeu_si128((__m128i*)(acc + k + 8), hi);
+	}
+	#endif
+	for (; k < n; ++k) acc[k] = (first ? 0 : acc[k]) + src[k];
+}
+
+/// Sums c pixels of the column sums and writes their rounded average over c*r into out
+static inline void average(const uint16_t *acc, int c, float scale, unsigned char out[4])
+{
+	#ifdef HAVE_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	__m128i s = zero;
+	int j = 0;
+	for (; j + 2 <= c; j += 2, acc += 8)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i*)acc);
+		s = _mm_add_epi32(s, _mm_add_epi32(_mm_unpacklo_epi16(a, zero), _mm_unpackhi_epi16(a, zero)));
+	}
+	if (j < c) s = _mm_add_epi32(s, _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)acc), zero));
+	__m128i v = _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(s), _mm_set1_ps(scale)));
+	v = _mm_packus_epi16(_mm_packs_epi32(v, zero), zero);
+	int32_t p = _mm_cvtsi128_si32(v);
+	memcpy(out, &p, 4);
+	#else
+	uint32_t s[4] = {0, 0, 0, 0};
+	for (int j = 0; j < c; ++j, acc += 4) for (int k = 0; k < 4; ++k) s[k] += acc[k];
+	for (int k = 0; k < 4; ++k) out[k] = (unsigned char)std::min(255L, lrintf((float)s[k] * scale));
+	#endif
+}
+
+void Downsample::rows(const unsigned char *src, unsigned sw, unsigned sh, int d, unsigned char *dst, unsigned y0, unsigned y1)
+{
+	assert(d >= 1 && d <= MAX_FACTOR);
+	const unsigned w = size(sw, d);
+	const size_t pitch = 4 * (size_t)sw;
+
+	thread_local std::vector<uint16_t> acc; // column sums of one row of blocks
+	if (acc.size() < pitch) acc.resize(pitch);
+
+	for (unsigned y = y0; y < y1; ++y)
+	{
+		const unsigned r0 = y * d, r = std::min(sh - r0, (unsigned)d);
+		for (unsigned i = 0; i < r; ++i) add_row(acc.data(), src + (r0 + i) * pitch, pitch, i == 0);
+
+		unsigned char *out = dst + 4 * (size_t)w * y;
+		const float full = 1.0f / (float)(r * d);
+		for (unsigned x = 0; x < w; ++x, out += 4)
+		{
+			const unsigned c = std::min(sw - x * d, (unsigned)d);
+			average(acc.data() + 4 * (size_t)x * d, c, c == (unsigned)d ? full : 1.0f / (float)(r * c), out);
+		}
+	}
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <cstddef>
+
+/**
+ * Box filter for RGBA images: pixel (x,y) of the result is the average of the d x d block of the
+ * source that starts at (d*x, d*y). Blocks at the right and bottom edge are cut off by the image
+ * border and averaged over what is left of them. For d = 2^k this is the k-th mipmap level, in a single
+ * pass and without rounding the levels in between.
+ */
+namespace Downsample
+{
+	const int MAX_FACTOR = 256; ///< Sums of a block column have to fit into 16 bits
+
+	/// Size of the result, rounded up
+	inline unsigned size(unsigned n, int d) { return (n + d - 1) / d; }
+
+	/**
+	 * Computes rows y0...y1-1 of the result, so the rows can be split up between threads.
+	 * @param src  sw x sh pixels
+	 * @param dst  size(sw,d) x size(sh,d) pixels
+	 */
+	void rows(const unsigned char *src, unsigned sw, unsigned sh, int d, unsigned char *dst, unsigned y0, unsigned y1);
+}
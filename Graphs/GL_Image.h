@@ -1,4 +1,5 @@
 #pragma once
+#include <utility>
 #include <vector>
 
 struct GL_Image
@@ -13,6 +14,13 @@ struct GL_Image
 	}
 
 	inline void clear() { redim(0, 0); }
+
+	void swap(GL_Image &x)
+	{
+		std::swap(_w, x._w);
+		std::swap(_h, x._h);
+		_data.swap(x._data);
+	}
 	
 	unsigned char *redim(unsigned w, unsigned h)
 	{
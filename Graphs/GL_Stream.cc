@@ -0,0 +1,134 @@
+#ifdef _WINDOWS
+#include <GL/glew.h> // glewInit is up to the window
+#else
+#define GL_GLEXT_PROTOTYPES // before anything includes gl.h
+#include <GL/gl.h>
+#include <GL/glext.h>
+#endif
+#include "GL_Stream.h"
+#include "GL_Util.h"
+#include <cstring>
+
+/// Is the context at least version major.minor or does it have the extension?
+static bool have(int major, int minor, const char *extension)
+{
+	const char *v = (const char*)glGetString(GL_VERSION);
+	int a = 0, b = 0;
+	if (v && sscanf(v, "%d.%d", &a, &b) == 2 && (a > major || (a == major && b >= minor))) return true;
+	const char *e = (const char*)glGetString(GL_EXTENSIONS);
+	return e && strstr(e, extension);
+}
+
+bool GL_Stream::supported()
+{
+	return have(2, 1, "GL_ARB_pixel_buffer_object");
+}
+
+GL_Stream::GL_Stream() : next(0), tw(0), th(0), fbo(0), invalidate(have(3, 0, "GL_ARB_map_buffer_range"))
+{
+	glGenTextures(1, &tex);
+	glBindTexture(GL_TEXTURE_2D, tex);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST); // same look as glPixelZoom
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glGenBuffers(2, pbo);
+	if (have(3, 0, "GL_ARB_framebuffer_object")) glGenFramebuffers(1, &fbo);
+	GL_CHECK;
+}
+
+GL_Stream::~GL_Stream()
+{
+	if (fbo) glDeleteFramebuffers(1, &fbo);
+	glDeleteBuffers(2, pbo);
+	glDeleteTextures(1, &tex);
+}
+
+void GL_Stream::draw(const GL_Image &im)
+{
+	if (im.empty()) return;
+	const size_t n = im.data().size();
+
+	GL_CHECK;
+	glBindTexture(GL_TEXTURE_2D, tex);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	if (im.w() != tw || im.h() != th)
+	{
+		tw = im.w(); th = im.h();
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, tw, th, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		for (unsigned b : pbo)
+		{
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, b);
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, n, NULL, GL_STREAM_DRAW);
+		}
+		if (fbo)
+		{
+			GLint read;
+			glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read);
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+			glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tex, 0);
+			if (glCheckFramebufferStatus(GL_READ_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			{
+				glDeleteFramebuffers(1, &fbo);
+				fbo = 0;
+			}
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, read);
+		}
+	}
+
+	// the other buffer can still be in transfer. This one was last used two frames ago, but the
+	// driver only knows it need not wait for that if we say its contents are not needed any more.
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo[next]);
+	void *p;
+	if (invalidate)
+	{
+		p = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, n, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	}
+	else
+	{
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, n, NULL, GL_STREAM_DRAW); // orphan it
+		p = glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+	}
+	if (p)
+	{
+		memcpy(p, im.data().data(), n);
+		if (glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER)) glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, tw, th, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	next ^= 1;
+
+	GLint vp[4];
+	glGetIntegerv(GL_VIEWPORT, vp);
+	if (fbo && (GLint)tw == vp[2] && (GLint)th == vp[3])
+	{
+		// unscaled, a blit is a plain copy and even software GL does not have to rasterize anything.
+		// scaled blits are no faster than the quad and slower on some drivers (llvmpipe).
+		GLint read;
+		glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+		glBlitFramebuffer(0, 0, tw, th, vp[0], vp[1], vp[0] + tw, vp[1] + th, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, read);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		GL_CHECK;
+		return;
+	}
+
+	glMatrixMode(GL_PROJECTION);
+	glLoadIdentity();
+	glOrtho(0.0, 1.0, 0.0, 1.0, -1.0, 1.0);
+	glMatrixMode(GL_MODELVIEW);
+	glLoadIdentity();
+
+	glEnable(GL_TEXTURE_2D);
+	glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+	glBegin(GL_QUADS); // the image is stored bottom row first, like the texture
+	glTexCoord2f(0.0f, 0.0f); glVertex2f(0.0f, 0.0f);
+	glTexCoord2f(1.0f, 0.0f); glVertex2f(1.0f, 0.0f);
+	glTexCoord2f(1.0f, 1.0f); glVertex2f(1.0f, 1.0f);
+	glTexCoord2f(0.0f, 1.0f); glVertex2f(0.0f, 1.0f);
+	glEnd();
+	glDisable(GL_TEXTURE_2D);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	GL_CHECK;
+}
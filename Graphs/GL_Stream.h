@@ -0,0 +1,35 @@
+#pragma once
+#include "GL_Image.h"
+
+/**
+ * Draws a stream of RGBA images into the viewport through a texture. The texture is kept and only
+ * reallocated when the image size changes. Uploads go through two pixel buffer objects in turns: the
+ * image gets copied into one while the driver can still be reading the other, and glTexSubImage2D from
+ * a pixel buffer returns without waiting for the transfer, unlike glDrawPixels. Every buffer gets
+ * invalidated (or orphaned) before it is mapped, so mapping never waits for an old transfer either.
+ * If the image has the size of the viewport and there are framebuffer objects (OpenGL 3.0), the texture
+ * gets blitted, otherwise it is drawn as a quad. Both are pixel for pixel what glPixelZoom does.
+ *
+ * Needs OpenGL 2.1 or ARB_pixel_buffer_object (see supported()) and a current context for everything,
+ * including the constructor and destructor.
+ */
+class GL_Stream
+{
+public:
+	GL_Stream();
+	~GL_Stream();
+	GL_Stream(const GL_Stream &) = delete;
+	GL_Stream &operator=(const GL_Stream &) = delete;
+
+	static bool supported();
+
+	/// Uploads im and draws it scaled to the whole viewport
+	void draw(const GL_Image &im);
+
+private:
+	unsigned tex, pbo[2]; // GLuint
+	int      next;        // pbo for the next upload
+	unsigned tw, th;      // texture size
+	unsigned fbo;         // with the texture attached, for blitting (0 without framebuffer objects)
+	bool     invalidate;  // map with GL_MAP_INVALIDATE_BUFFER_BIT instead of orphaning the buffer first
+};
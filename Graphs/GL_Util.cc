@@ -45,25 +45,39 @@ void hsl(double h, double s, double l, unsigned char buf[4])
 	*buf = 255;
 }
 
-static inline double arg(double y, double x)
-{
-	double f = std::max(abs(x), abs(y));
-	if (f < 1e-40) return 0.0;
-	double a = std::min(abs(x), abs(y)) / f;
-	double s = a * a;
-	double r = ((-0.0464964749 * s + 0.15931422) * s - 0.327622764) * s * a + a;
-	if (abs(y) > abs(x)) r = M_PI_2 - r;
-	if (x < 0) r = M_PI - r;
-	if (y < 0) r = -r;
-	return r * 0.5*M_1_PI; // range [-0.5, 0.5]
-}
-
 void hsl(const cnum &e, unsigned char pixel[4])
 {
 	double x = e.real(), y = e.imag();
 	double v = hypot(x, y);
-	hsl(arg(y, x) + 1.0, 1.0, std::min(v*0.3, 0.9), pixel);
+	hsl(phase(y, x) + 1.0, 1.0, std::min(v*0.3, 0.9), pixel);
+}
+
+bool ColorMap::precise = false;
+alignas(64) uint32_t ColorMap::table[LEVELS][PHASES];
+
+void ColorMap::build()
+{
+	for (int l = 0; l < LEVELS; ++l)
+	{
+		// the middle of the level's float bit patterns
+		const uint32_t b = (uint32_t)(l + ((127 + MIN_EXP) << MANTISSA_BITS)) << (23 - MANTISSA_BITS) | 1u << (22 - MANTISSA_BITS);
+		float r; memcpy(&r, &b, 4);
+		const double v = sqrt((double)r);
+
+		for (int o = 0; o < 8; ++o)
+		for (int a = 0; a <= RATIOS; ++a)
+		{
+			double x = 1.0, y = (double)a / RATIOS;
+			if (o & 4) std::swap(x, y);
+			if (o & 1) x = -x;
+			if (o & 2) y = -y;
+			unsigned char c[4];
+			hsl(cnum(x, y) * (v / hypot(x, y)), c);
+			memcpy(&table[l][o * (RATIOS + 1) + a], c, 4);
+		}
+	}
 }
+static struct BuildColorMap { BuildColorMap() { ColorMap::build(); } } build_color_map;
 
 
 #if 0
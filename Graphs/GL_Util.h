@@ -1,11 +1,67 @@
 #pragma once
 #include <GL/gl.h>
 #include <cassert>
+#include <cstdint>
+#include <cstring>
 #include "../cnum.h"
 
 void hsl(double h, double s, double l, unsigned char buf[4]);
 void hsl(const cnum &z, unsigned char buf[4]);
 
+/// arg(x + iy) / 2pi, in [-0.5, 0.5] and good to about 1e-5
+inline double phase(double y, double x)
+{
+	double f = std::max(abs(x), abs(y));
+	if (f < 1e-40) return 0.0;
+	double a = std::min(abs(x), abs(y)) / f;
+	double s = a * a;
+	double r = ((-0.0464964749 * s + 0.15931422) * s - 0.327622764) * s * a + a;
+	if (abs(y) > abs(x)) r = M_PI_2 - r;
+	if (x < 0) r = M_PI - r;
+	if (y < 0) r = -r;
+	return r * 0.5*M_1_PI;
+}
+
+/**
+ * hsl(z) from a table of colors, which is built once at startup. It is indexed by
+ * - the phase: the octant (the signs of x and y and which one is larger) and min/max of |x| and |y|,
+ *   rounded to RATIOS steps, so there is no arctangent
+ * - |z|^2, by the exponent and top bits of its float, which are about its logarithm: STEPS levels
+ *   per octave from 2^MIN_EXP to 2^(MIN_EXP+OCTAVES), above 9 the lightness does not change anyway
+ * so a color is a division, a few integer operations and a 4 byte load. Compared to hsl(z), it is
+ * off by 0.3 steps of 255 per channel on average and by 8 at most. The table has 264 KiB.
+ */
+struct ColorMap
+{
+	static const int RATIOS = 32, PHASES = 8 * (RATIOS + 1);
+	static const int MANTISSA_BITS = 4, STEPS = 1 << MANTISSA_BITS, MIN_EXP = -12, OCTAVES = 16, LEVELS = STEPS * OCTAVES;
+
+	static bool precise; ///< If set, color calls hsl(z) for every pixel
+
+	static inline void color(const cnum &z, unsigned char pixel[4])
+	{
+		const double x = z.real(), y = z.imag(), r = x*x + y*y;
+		if (precise || !defined(r)) { hsl(z, pixel); return; } // NaN, Inf or too large to square
+
+		const float rf = (float)r;
+		uint32_t b; memcpy(&b, &rf, 4);
+		int l = (int)(b >> (23 - MANTISSA_BITS)) - ((127 + MIN_EXP) << MANTISSA_BITS);
+		l = l < 0 ? 0 : l < LEVELS ? l : LEVELS - 1;
+
+		const double ax = abs(x), ay = abs(y);
+		const bool steep = ay > ax;
+		const double lo = steep ? ax : ay, hi = steep ? ay : ax;
+		const int a = hi > 0.0 ? (int)(lo / hi * RATIOS + 0.5) : 0;
+		const int o = (x < 0.0) | (y < 0.0) << 1 | steep << 2;
+		memcpy(pixel, &table[l][o * (RATIOS + 1) + a], 4);
+	}
+
+	static void build(); ///< Fills the table, runs before main
+
+private:
+	static uint32_t table[LEVELS][PHASES]; // RGBA
+};
+
 #ifdef DEBUG
 #include <GL/glu.h>
 #include <iostream>
@@ -0,0 +1,83 @@
+#include "Kernels.h"
+#include "../Graphs/GL_Util.h" // for Display.h, its inline functions must not get the target options
+
+#if defined(__x86_64__) || defined(_M_X64)
+
+#ifdef __GNUC__
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+#endif
+#include <immintrin.h>
+
+namespace {
+
+struct V64 // 4 doubles
+{
+	typedef double T;
+	static const int N = 4;
+	__m256d v;
+
+	V64() { }
+	V64(__m256d x) : v(x) { }
+	explicit V64(double x) : v(_mm256_set1_pd(x)) { }
+
+	static inline V64 load(const T *p) { return _mm256_loadu_pd(p); }
+	static inline V64 load(const float *p) { return _mm256_cvtps_pd(_mm_loadu_ps(p)); } // float metric
+	inline void store(T *p) const { _mm256_storeu_pd(p, v); }
+
+	inline V64 operator+ (const V64 &x) const { return _mm256_add_pd(v, x.v); }
+	inline V64 operator- (const V64 &x) const { return _mm256_sub_pd(v, x.v); }
+	inline V64 operator* (const V64 &x) const { return _mm256_mul_pd(v, x.v); }
+	inline V64 operator- () const { return _mm256_mul_pd(v, _mm256_set1_pd(-1.0)); }
+};
+
+struct V32 // 8 floats
+{
+	typedef float T;
+	static const int N = 8;
+	typedef __m256 M;
+	__m256 v;
+
+	V32() { }
+	V32(__m256 x) : v(x) { }
+	explicit V32(double x) : v(_mm256_set1_ps((float)x)) { }
+
+	static inline V32 load(const T *p) { return _mm256_loadu_ps(p); }
+	static inline V32 load(const double *p) { return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(_mm256_loadu_pd(p))), _mm256_cvtpd_ps(_mm256_loadu_pd(p+4)), 1); }
+	inline void store(T *p) const { _mm256_storeu_ps(p, v); }
+
+	inline V32 operator+ (const V32 &x) const { return _mm256_add_ps(v, x.v); }
+	inline V32 operator- (const V32 &x) const { return _mm256_sub_ps(v, x.v); }
+	inline V32 operator* (const V32 &x) const { return _mm256_mul_ps(v, x.v); }
+	inline V32 operator- () const { return _mm256_mul_ps(v, _mm256_set1_ps(-1.0f)); }
+	inline V32 operator/ (const V32 &x) const { return _mm256_div_ps(v, x.v); }
+	inline M   operator< (const V32 &x) const { return _mm256_cmp_ps(v, x.v, _CMP_LT_OQ); }
+
+	inline V32 abs() const { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), v); }
+	inline V32 sqrt() const { return _mm256_sqrt_ps(v); }
+	static inline V32 min(const V32 &a, const V32 &b) { return _mm256_min_ps(a.v, b.v); }
+	static inline V32 max(const V32 &a, const V32 &b) { return _mm256_max_ps(a.v, b.v); }
+	static inline V32 select(M m, const V32 &a, const V32 &b) { return _mm256_blendv_ps(b.v, a.v, m); }
+	static inline int  bits(M m) { return _mm256_movemask_ps(m); }
+
+	static inline void store_rgba(const V32 &r, const V32 &g, const V32 &b, unsigned char *p)
+	{
+		__m256i c = _mm256_or_si256(_mm256_cvttps_epi32(r.v), _mm256_slli_epi32(_mm256_cvttps_epi32(g.v), 8));
+		c = _mm256_or_si256(c, _mm256_or_si256(_mm256_slli_epi32(_mm256_cvttps_epi32(b.v), 16), _mm256_set1_epi32((int)0xFF000000)));
+		_mm256_storeu_si256((__m256i*)p, c);
+	}
+};
+
+} // namespace
+
+#include "Evolve.h"
+#include "Display.h"
+
+extern const Kernels kernels_avx2;
+const Kernels kernels_avx2 = { "AVX2", V64::N, evolve_row<V64>, evolve_row<V32>, display_row<V32, double>, display_row<V32, float> };
+
+#ifdef __GNUC__
+#pragma GCC pop_options
+#endif
+
+#endif
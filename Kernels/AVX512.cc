@@ -0,0 +1,95 @@
+#include "Kernels.h"
+#include "../Graphs/GL_Util.h" // for Display.h, its inline functions must not get the target options
+
+#if defined(__x86_64__) || defined(_M_X64)
+
+#ifdef __GNUC__
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+#ifndef __clang__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized" // _mm512_undefined_ps and friends, once inlined
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+#endif
+#include <immintrin.h>
+
+namespace {
+
+struct V64 // 8 doubles
+{
+	typedef double T;
+	static const int N = 8;
+	__m512d v;
+
+	V64() { }
+	V64(__m512d x) : v(x) { }
+	explicit V64(double x) : v(_mm512_set1_pd(x)) { }
+
+	static inline V64 load(const T *p) { return _mm512_loadu_pd(p); }
+	static inline V64 load(const float *p) { return _mm512_cvtps_pd(_mm256_loadu_ps(p)); } // float metric
+	inline void store(T *p) const { _mm512_storeu_pd(p, v); }
+
+	inline V64 operator+ (const V64 &x) const { return _mm512_add_pd(v, x.v); }
+	inline V64 operator- (const V64 &x) const { return _mm512_sub_pd(v, x.v); }
+	inline V64 operator* (const V64 &x) const { return _mm512_mul_pd(v, x.v); }
+	inline V64 operator- () const { return _mm512_mul_pd(v, _mm512_set1_pd(-1.0)); }
+};
+
+struct V32 // 16 floats
+{
+	typedef float T;
+	static const int N = 16;
+	typedef __mmask16 M;
+	__m512 v;
+
+	V32() { }
+	V32(__m512 x) : v(x) { }
+	explicit V32(double x) : v(_mm512_set1_ps((float)x)) { }
+
+	static inline V32 load(const T *p) { return _mm512_loadu_ps(p); }
+	static inline V32 load(const double *p)
+	{
+		__m256 a = _mm512_cvtpd_ps(_mm512_loadu_pd(p)), b = _mm512_cvtpd_ps(_mm512_loadu_pd(p+8));
+		return _mm512_castpd_ps(_mm512_insertf64x4(_mm512_castps_pd(_mm512_castps256_ps512(a)), _mm256_castps_pd(b), 1));
+	}
+	inline void store(T *p) const { _mm512_storeu_ps(p, v); }
+
+	inline V32 operator+ (const V32 &x) const { return _mm512_add_ps(v, x.v); }
+	inline V32 operator- (const V32 &x) const { return _mm512_sub_ps(v, x.v); }
+	inline V32 operator* (const V32 &x) const { return _mm512_mul_ps(v, x.v); }
+	inline V32 operator- () const { return _mm512_mul_ps(v, _mm512_set1_ps(-1.0f)); }
+	inline V32 operator/ (const V32 &x) const { return _mm512_div_ps(v, x.v); }
+	inline M   operator< (const V32 &x) const { return _mm512_cmp_ps_mask(v, x.v, _CMP_LT_OQ); }
+
+	inline V32 abs() const { return _mm512_abs_ps(v); }
+	inline V32 sqrt() const { return _mm512_sqrt_ps(v); }
+	static inline V32 min(const V32 &a, const V32 &b) { return _mm512_min_ps(a.v, b.v); }
+	static inline V32 max(const V32 &a, const V32 &b) { return _mm512_max_ps(a.v, b.v); }
+	static inline V32 select(M m, const V32 &a, const V32 &b) { return _mm512_mask_blend_ps(m, b.v, a.v); }
+	static inline int  bits(M m) { return m; }
+
+	static inline void store_rgba(const V32 &r, const V32 &g, const V32 &b, unsigned char *p)
+	{
+		__m512i c = _mm512_or_si512(_mm512_cvttps_epi32(r.v), _mm512_slli_epi32(_mm512_cvttps_epi32(g.v), 8));
+		c = _mm512_or_si512(c, _mm512_or_si512(_mm512_slli_epi32(_mm512_cvttps_epi32(b.v), 16), _mm512_set1_epi32((int)0xFF000000)));
+		_mm512_storeu_si512(p, c);
+	}
+};
+
+} // namespace
+
+#include "Evolve.h"
+#include "Display.h"
+
+extern const Kernels kernels_avx512;
+const Kernels kernels_avx512 = { "AVX-512", V64::N, evolve_row<V64>, evolve_row<V32>, display_row<V32, double>, display_row<V32, float> };
+
+#ifdef __GNUC__
+#ifndef __clang__
+#pragma GCC diagnostic pop
+#endif
+#pragma GCC pop_options
+#endif
+
+#endif
@@ -0,0 +1,132 @@
+#pragma once
+// Generic body of the display row kernels, included after Evolve.h. Colors are computed in float for
+// both simulation types, so V is always the float vector type, and on top of what Evolve.h uses it needs
+//   V::M                          comparison mask
+//   V::load(const double*)        converting
+//   / and <
+//   v.abs(), v.sqrt(), V::min(a, b), V::max(a, b)
+//   V::select(m, a, b)            m ? a : b
+//   V::bits(m)                    m as an int, bit j for point j
+//   V::store_rgba(r, g, b, p)     truncates r, g, b in [0,255] to bytes and writes N RGBA pixels to p
+// Everything in here has internal linkage, so the differently compiled copies never get mixed up.
+// GL_Util.h has to be included before the target options are set.
+
+namespace {
+
+/// 6 * phase(y, x), the hue in sixths of a turn in [-3, 3]
+template<class V> inline V hue6(const V &x, const V &y)
+{
+	const V ax = x.abs(), ay = y.abs();
+	const V f = V::max(V::max(ax, ay), V(std::numeric_limits<float>::min())); // phase is 0 for 0
+	const V a = V::min(ax, ay) / f;
+	const V s = a * a;
+	V r = ((V(-0.0464964749) * s + V(0.15931422)) * s - V(0.327622764)) * s * a + a;
+	r = V::select(ax < ay, V(M_PI_2) - r, r);
+	r = V::select(x < V(0.0), V(M_PI) - r, r);
+	r = V::select(y < V(0.0), -r, r);
+	return r * V(3.0 * M_1_PI);
+}
+
+/**
+ * hsl(x + iy) for N points, branch free: channel c of the color with hue h is p + (q-p) * w,
+ * where w goes from 1 at hue 0 to 0 at hue 1/3 and back to 1 at hue 2/3 (for red; green is shifted by
+ * 1/3 and blue by 2/3). That is the 6-way switch in hsl, with min and max instead of the sectors.
+ * @return bit j set if point j is not finite (or too large for float), its pixel is garbage then
+ */
+template<class V> inline int colors(const V &x, const V &y, unsigned char *data)
+{
+	const V rq = x * x + y * y;
+	const int bad = ~V::bits(rq < V(std::numeric_limits<float>::infinity())) & ((1 << V::N) - 1);
+
+	const V l = V::min(rq.sqrt() * V(0.3), V(0.9)) * V(255.0);
+	const V q = l + V::min(l, V(255.0) - l);
+	const V p = l + l - q, d = q - p;
+
+	const V h = hue6(x, y);
+	auto channel = [&](const V &shift)
+	{
+		V t = (h + shift).abs();
+		t = V::min(t, V(6.0) - t); // distance to hue 0, |h + shift| <= 5
+		return p + d * V::max(V::min(V(2.0) - t, V(1.0)), V(0.0));
+	};
+	V::store_rgba(channel(V(0.0)), channel(V(-2.0)), channel(V(2.0)), data);
+	return bad;
+}
+
+/**
+ * Displays the n points from i. xy(re, im, j, Y, x, y) sets x + iy for the N points from j, reading
+ * re and im (with row pitch Y) up to reach points or rows around them. If n is less than N, the rows
+ * get copied with zeros around, so every pixel comes from colors and one frame has one color function.
+ * Points that are not finite go through Point::display.
+ */
+template<class V, int reach, typename T, class XY>
+void color_row(const Field<T> &F, const T *re, const T *im, ptrdiff_t i, int n, unsigned char *data, XY xy)
+{
+	auto step = [&](const T *re, const T *im, ptrdiff_t j, ptrdiff_t Y, ptrdiff_t i, unsigned char *data)
+	{
+		V x, y;
+		xy(re, im, j, Y, x, y);
+		for (int bad = colors(x, y, data), k = 0; bad; bad >>= 1, ++k)
+		{
+			if (bad & 1) Point::display(F, i + k, data + 4*k);
+		}
+	};
+
+	if (n >= V::N)
+	{
+		// the last step overlaps the one before unless n fits
+		const ptrdiff_t last = i + n - V::N;
+		for (; i < last; i += V::N, data += 4*V::N) step(re, im, i, Point::Y, i, data);
+		step(re, im, last, Point::Y, last, data - 4*(i - last));
+		return;
+	}
+
+	constexpr int P = V::N + 2*reach; // pitch of the copy
+	T r[(2*reach + 1) * P] = { }, m[(2*reach + 1) * P] = { };
+	for (int d = -reach; d <= reach; ++d)
+	{
+		const ptrdiff_t s = i + d * (ptrdiff_t)Point::Y - reach, t = (d + reach) * P;
+		for (int j = 0; j < n + 2*reach; ++j) { r[t + j] = re[s + j]; m[t + j] = im[s + j]; }
+	}
+	unsigned char pixels[4 * V::N];
+	step(r, m, reach * P + reach, P, i, pixels);
+	memcpy(data, pixels, 4 * n);
+}
+
+template<class V, typename T> void display_row(const Field<T> &F, ptrdiff_t i, int n, unsigned char *data)
+{
+	if (ColorMap::precise)
+	{
+		for (ptrdiff_t end = i + n; i < end; ++i, data += 4) Point::display(F, i, data);
+		return;
+	}
+
+	auto z = [](const T *re, const T *im, ptrdiff_t j, ptrdiff_t, V &x, V &y)
+	{
+		x = V::load(re+j);
+		y = V::load(im+j);
+	};
+
+	#if EQUATION==DIRAC
+
+	const int k = (Point::vis % 4 + 4) % 4;
+	color_row<V, 0>(F, F.re(k), F.im(k), i, n, data, z);
+
+	#else
+
+	auto impulse = [](const T *re, const T *im, ptrdiff_t j, ptrdiff_t Y, V &x, V &y) // cf. Point::px and Point::py
+	{
+		const V zr = V::load(re+j), zi = V::load(im+j);
+		const V xr = V::load(re+j-1) - V::load(re+j+1), xi = V::load(im+j-1) - V::load(im+j+1);
+		const V yr = V::load(re+j-Y) - V::load(re+j+Y), yi = V::load(im+j-Y) - V::load(im+j+Y);
+		x = (xr * zi - xi * zr) * V(0.5);
+		y = (yr * zi - yi * zr) * V(0.5);
+	};
+	const T *re = F.re(Point::e), *im = F.im(Point::e);
+	if ((Point::vis % 2 + 2) % 2 == 0) color_row<V, 0>(F, re, im, i, n, data, z);
+	else color_row<V, 1>(F, re, im, i, n, data, impulse);
+
+	#endif
+}
+
+} // namespace
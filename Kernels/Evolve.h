@@ -0,0 +1,135 @@
+#pragma once
+// Generic body of the evolve row kernels. Only to be included by the per-ISA translation units,
+// after they defined their vector types V, which need
+//   V::T                 scalar type (float or double)
+//   V::N                 number of scalars per vector
+//   V(double)            broadcast
+//   V::load(const T*), v.store(T*)   unaligned
+//   V::load(const float*)            for double vectors, if the metric is stored in float
+//   +, -, * and unary -
+// Everything in here has internal linkage, so the differently compiled copies never get mixed up.
+
+namespace {
+
+template<class V> struct VZ // N complex numbers
+{
+	typedef Field<typename V::T> F_;
+	V re, im;
+	VZ() { }
+	VZ(const V &re, const V &im) : re(re), im(im) { }
+	VZ(const F_ &F, int k, ptrdiff_t i) : re(V::load(F.re(k)+i)), im(V::load(F.im(k)+i)) { }
+
+	inline VZ operator+ (const VZ &z) const { return VZ(re + z.re, im + z.im); }
+	inline VZ operator- (const VZ &z) const { return VZ(re - z.re, im - z.im); }
+	inline VZ operator* (const V &x) const { return VZ(re * x, im * x); }
+
+	inline void store(const F_ &F, int k, ptrdiff_t i) const { re.store(F.re(k)+i); im.store(F.im(k)+i); }
+	inline void add  (const F_ &F, int k, ptrdiff_t i) const { (V::load(F.re(k)+i) + re).store(F.re(k)+i); (V::load(F.im(k)+i) + im).store(F.im(k)+i); }
+	inline void put  (const F_ &F, int k, ptrdiff_t i) const { if (Point::MOD_OVERLAP > 0) add(F, k, i); else store(F, k, i); } // cf. Point::put
+};
+
+/// c * z for a constant c, which makes all the zero and +-1 multiplications go away
+template<const cnum &c, class V> inline VZ<V> cmul(const VZ<V> &z)
+{
+	constexpr double a = c.real(), b = c.imag();
+	if constexpr (b == 0.0)
+	{
+		if constexpr (a ==  0.0) return VZ<V>(V(0.0), V(0.0));
+		if constexpr (a ==  1.0) return z;
+		if constexpr (a == -1.0) return VZ<V>(-z.re, -z.im);
+		return z * V(a);
+	}
+	else if constexpr (a == 0.0)
+	{
+		if constexpr (b ==  1.0) return VZ<V>(-z.im, z.re);
+		if constexpr (b == -1.0) return VZ<V>(z.im, -z.re);
+		return VZ<V>(-z.im * V(b), z.re * V(b));
+	}
+	else
+	{
+		return VZ<V>(z.re * V(a) - z.im * V(b), z.im * V(a) + z.re * V(b));
+	}
+}
+
+template<class V> struct Stencil
+{
+	const Field<typename V::T> &F;
+	ptrdiff_t i, Y;
+	V gx, gy;
+
+	inline VZ<V> at(int k, ptrdiff_t d) const { return VZ<V>(F, k, i+d); }
+
+	inline VZ<V> laplace(int k = 0) const
+	{
+		const V one(1.0), four(4.0);
+		return at(k, -1) * (one-gx) + at(k, +1) * (one+gx) + at(k, -Y) * (one-gy) + at(k, +Y) * (one+gy) - at(k, 0) * four;
+	}
+	inline VZ<V> dfdx(int k = 0) const
+	{
+		const V one(1.0), half(0.5);
+		return (at(k, +1) * (one+gx) - at(k, -1) * (one-gx)) * half - at(k, 0) * gx;
+	}
+	inline VZ<V> dfdy(int k = 0) const
+	{
+		const V one(1.0), half(0.5);
+		return (at(k, +Y) * (one+gy) - at(k, -Y) * (one-gy)) * half - at(k, 0) * gy;
+	}
+};
+
+#if EQUATION==DIRAC
+/// m * ix(z)
+template<class V> inline VZ<V> mix(double m, const VZ<V> &z)
+{
+	if (m == 1.0) return VZ<V>(-z.im, z.re);
+	return VZ<V>(-z.im * V(m), z.re * V(m));
+}
+#endif
+
+template<class V> void evolve_row(Field<typename V::T> &F, const Field<typename V::T> &P, const Metric<typename V::T> &G, ptrdiff_t i, int n)
+{
+	const ptrdiff_t end = i + n;
+	Stencil<V> s{P, i, (ptrdiff_t)Point::Y, V(0.0), V(0.0)};
+
+	for (; i + V::N <= end; i += V::N)
+	{
+		s.i  = i;
+		s.gx = V::load(G.x + i);
+		s.gy = V::load(G.y + i);
+		const V dt = V(0.1) * V::load(G.z + i);
+
+		#if EQUATION==DIRAC
+
+		VZ<V> z;
+		z = s.at(0, 0);
+		z = z - (cmul<Point::c03>(s.dfdx(3)) - cmul<Point::c02>(s.dfdy(2)) - mix(Point::m0, z)) * dt;
+		z.put(F, 0, i);
+		z = s.at(1, 0);
+		z = z - (cmul<Point::c12>(s.dfdx(2)) - cmul<Point::c13>(s.dfdy(3)) - mix(Point::m1, z)) * dt;
+		z.put(F, 1, i);
+		z = s.at(2, 0);
+		z = z - (cmul<Point::c21>(s.dfdx(1)) - cmul<Point::c20>(s.dfdy(0)) - mix(Point::m2, z)) * dt;
+		z.put(F, 2, i);
+		z = s.at(3, 0);
+		z = z - (cmul<Point::c30>(s.dfdx(0)) - cmul<Point::c31>(s.dfdy(1)) - mix(Point::m3, z)) * dt;
+		z.put(F, 3, i);
+
+		#elif EQUATION==MAXWELL
+
+		VZ<V> de = s.at(Point::de, 0) + s.laplace() * dt;
+		de.store(F, Point::de, i);
+		(s.at(Point::e, 0) + de * dt).store(F, Point::e, i);
+
+		#elif EQUATION==KLEINGORDON
+
+		VZ<V> e = s.at(Point::e, 0);
+		VZ<V> de = s.at(Point::de, 0) + (s.laplace() - e) * dt;
+		de.store(F, Point::de, i);
+		(e + de * dt).store(F, Point::e, i);
+
+		#endif
+	}
+
+	for (; i < end; ++i) Point::evolve(F, P, G, i);
+}
+
+} // namespace
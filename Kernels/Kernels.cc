@@ -0,0 +1,197 @@
+#include "Kernels.h"
+#include <iostream>
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+template<typename T>
+static void evolve_scalar(Field<T> &F, const Field<T> &F0, const Metric<T> &G, ptrdiff_t i, int n)
+{
+	for (ptrdiff_t end = i + n; i < end; ++i) Point::evolve(F, F0, G, i);
+}
+
+template<typename T>
+static void display_scalar(const Field<T> &F, ptrdiff_t i, int n, unsigned char *data)
+{
+	for (ptrdiff_t end = i + n; i < end; ++i, data += 4) Point::display(F, i, data);
+}
+
+static const Kernels kernels_scalar = { "scalar", 1, evolve_scalar<double>, evolve_scalar<float>, display_scalar<double>, display_scalar<float> };
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define HAVE_X86_KERNELS
+extern const Kernels kernels_sse2, kernels_avx2, kernels_avx512;
+#endif
+
+static const Kernels *table(Kernels::ISA isa)
+{
+	switch (isa)
+	{
+		case Kernels::SCALAR: return &kernels_scalar;
+		#ifdef HAVE_X86_KERNELS
+		case Kernels::SSE2:   return &kernels_sse2;
+		case Kernels::AVX2:   return &kernels_avx2;
+		case Kernels::AVX512: return &kernels_avx512;
+		#endif
+		default: return NULL;
+	}
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// CPU detection
+//----------------------------------------------------------------------------------------------------------------------
+
+bool Kernels::supported(ISA isa)
+{
+	if (!table(isa)) return false;
+	if (isa == SCALAR) return true;
+
+	#if defined(HAVE_X86_KERNELS) && defined(__GNUC__)
+
+	__builtin_cpu_init(); // we might get called before the constructors
+	switch (isa)
+	{
+		case SSE2:   return __builtin_cpu_supports("sse2");
+		case AVX2:   return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+		case AVX512: return __builtin_cpu_supports("avx512f");
+		default:     return false;
+	}
+
+	#elif defined(HAVE_X86_KERNELS) && defined(_MSC_VER)
+
+	if (isa == SSE2) return true; // part of x64
+	int r[4]; __cpuid(r, 1);
+	bool fma = (r[2] >> 12) & 1, osxsave = (r[2] >> 27) & 1, avx = (r[2] >> 28) & 1;
+	if (!osxsave || !avx) return false;
+	unsigned long long xcr0 = _xgetbv(0);
+	__cpuidex(r, 7, 0);
+	switch (isa)
+	{
+		case AVX2:   return (xcr0 & 0x06) == 0x06 && ((r[1] >> 5) & 1) && fma;
+		case AVX512: return (xcr0 & 0xE6) == 0xE6 && ((r[1] >> 16) & 1);
+		default:     return false;
+	}
+
+	#else
+	return false;
+	#endif
+}
+
+Kernels::ISA Kernels::best()
+{
+	for (int i = N_ISA-1; i > SCALAR; --i)
+	{
+		if (supported((ISA)i)) return (ISA)i;
+	}
+	return SCALAR;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// selection
+//----------------------------------------------------------------------------------------------------------------------
+
+const Kernels *Kernels::current = table(Kernels::best());
+bool Kernels::verify = false;
+
+bool Kernels::select(ISA isa)
+{
+	if (!supported(isa)) return false;
+	current = table(isa);
+	return true;
+}
+
+Kernels::ISA Kernels::selected()
+{
+	for (int i = 0; i < N_ISA; ++i)
+	{
+		if (table((ISA)i) == current) return (ISA)i;
+	}
+	assert(false);
+	return SCALAR;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// verification
+//----------------------------------------------------------------------------------------------------------------------
+
+template<> Kernels::EvolveRow<double> Kernels::evolve() const { return evolve64; }
+template<> Kernels::EvolveRow<float>  Kernels::evolve() const { return evolve32; }
+
+// The kernels may use FMA, so results can differ by rounding errors of the
+// summands, which can be much larger than the result itself.
+template<typename T> static inline bool agree(T a, T b, T scale)
+{
+	if (a == b || (isnan(a) && isnan(b))) return true;
+	const T eps = std::numeric_limits<T>::epsilon() * 4096;
+	return std::abs(a - b) <= eps * std::max(scale, std::max(std::abs(a), std::abs(b)));
+}
+
+template<typename T>
+void Kernels::evolve_checked(Field<T> &F, const Field<T> &F0, const Metric<T> &G, ptrdiff_t i, int n)
+{
+	if (current == &kernels_scalar || n <= 0)
+	{
+		evolve_scalar(F, F0, G, i, n);
+		return;
+	}
+
+	// run the kernel on a copy of the target row, then the reference on the original
+	thread_local std::vector<T> saved, fast;
+	const size_t rs = n * sizeof(T);
+	saved.resize(Field<T>::PLANES * n);
+	fast.resize(Field<T>::PLANES * n);
+	for (int k = 0; k < Field<T>::PLANES; ++k) memcpy(&saved[k*n], F.plane[k] + i, rs);
+	current->evolve<T>()(F, F0, G, i, n);
+	for (int k = 0; k < Field<T>::PLANES; ++k)
+	{
+		memcpy(&fast[k*n], F.plane[k] + i, rs);
+		memcpy(F.plane[k] + i, &saved[k*n], rs);
+	}
+	evolve_scalar(F, F0, G, i, n);
+
+	for (int k = 0; k < Field<T>::PLANES; ++k)
+	{
+		T scale = 0;
+		for (int j = 0; j < n; ++j) scale = std::max(scale, std::abs(F.plane[k][i + j]));
+
+		for (int j = 0; j < n; ++j)
+		{
+			T a = fast[k*n + j], b = F.plane[k][i + j];
+			if (agree(a, b, scale)) continue;
+			std::cerr << current->name << " evolve differs from Point::evolve at point " << i + j
+			          << ", plane " << k << ": " << a << " != " << b << std::endl;
+			return; // one report per row is plenty
+		}
+	}
+}
+
+template void Kernels::evolve_checked(Field<float>  &, const Field<float>  &, const Metric<float>  &, ptrdiff_t, int);
+template void Kernels::evolve_checked(Field<double> &, const Field<double> &, const Metric<double> &, ptrdiff_t, int);
+
+template<> Kernels::DisplayRow<double> Kernels::display() const { return display64; }
+template<> Kernels::DisplayRow<float>  Kernels::display() const { return display32; }
+
+template<typename T>
+void Kernels::display_checked(const Field<T> &F, ptrdiff_t i, int n, unsigned char *data)
+{
+	display_scalar(F, i, n, data);
+	if (current == &kernels_scalar || n <= 0) return;
+
+	thread_local std::vector<unsigned char> fast;
+	fast.resize(4 * (size_t)n);
+	current->display<T>()(F, i, n, fast.data());
+
+	// the kernels compute the colors (within 1 of hsl), Point::display looks them up in the ColorMap (within 8)
+	const int tolerance = 9;
+	for (int j = 0; j < 4*n; ++j)
+	{
+		if (std::abs(fast[j] - data[j]) <= tolerance) continue;
+		std::cerr << current->name << " display differs from Point::display at point " << i + j/4
+		          << ", channel " << j%4 << ": " << (int)fast[j] << " != " << (int)data[j] << std::endl;
+		return;
+	}
+}
+
+template void Kernels::display_checked(const Field<float>  &, ptrdiff_t, int, unsigned char *);
+template void Kernels::display_checked(const Field<double> &, ptrdiff_t, int, unsigned char *);
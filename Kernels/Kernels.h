@@ -0,0 +1,76 @@
+#pragma once
+#include "../Point.h"
+
+/**
+ * @defgroup Kernels Row Kernels
+ * @{
+ */
+
+/**
+ * Vectorized versions of the Point methods that run along a row of n points, starting at index i.
+ * There is one set per instruction set. The widest one the CPU supports is selected at startup,
+ * the scalar set just calls Point::evolve and Point::display and is the reference for all others.
+ */
+struct Kernels
+{
+	enum ISA { SCALAR, SSE2, AVX2, AVX512, N_ISA };
+
+	template<typename T> using EvolveRow = void (*)(Field<T> &F, const Field<T> &F0, const Metric<T> &G, ptrdiff_t i, int n);
+	template<typename T> using DisplayRow = void (*)(const Field<T> &F, ptrdiff_t i, int n, unsigned char *data);
+
+	const char       *name;
+	int               width;    ///< Number of double precision points per instruction (twice as many in float)
+	EvolveRow<double> evolve64; ///< Same as calling Point::evolve for i...i+n-1
+	EvolveRow<float>  evolve32;
+
+	/**
+	 * Same as calling Point::display for i...i+n-1 into data, data+4, ..., except that the colors
+	 * are computed (in float, twice width points at once) instead of looked up in the ColorMap.
+	 * That includes rows shorter than a vector, so callers should use them for single points too.
+	 * With ColorMap::precise, and for points that are not finite, they call Point::display.
+	 */
+	DisplayRow<double> display64;
+	DisplayRow<float>  display32;
+
+	static const Kernels &get() { return *current; } ///< The selected kernels
+
+	static ISA  best();             ///< Widest instruction set that is compiled in and supported by the CPU
+	static bool supported(ISA isa);
+	static bool select(ISA isa);    ///< @return false if isa is not supported, selection stays unchanged then
+	static ISA  selected();
+
+	/**
+	 * If set, evolve_row and display_row run the scalar reference after the selected kernel and report
+	 * any differences on stderr. The result of the reference is kept.
+	 */
+	static bool verify;
+
+	/// Calls the selected evolve kernel (and checks it against Point::evolve if verify is set)
+	static inline void evolve_row(Field<double> &F, const Field<double> &F0, const Metric<double> &G, ptrdiff_t i, int n)
+	{
+		if (verify) evolve_checked(F, F0, G, i, n); else current->evolve64(F, F0, G, i, n);
+	}
+	static inline void evolve_row(Field<float> &F, const Field<float> &F0, const Metric<float> &G, ptrdiff_t i, int n)
+	{
+		if (verify) evolve_checked(F, F0, G, i, n); else current->evolve32(F, F0, G, i, n);
+	}
+
+	/// Calls the selected display kernel (and checks it against Point::display if verify is set)
+	static inline void display_row(const Field<double> &F, ptrdiff_t i, int n, unsigned char *data)
+	{
+		if (verify) display_checked(F, i, n, data); else current->display64(F, i, n, data);
+	}
+	static inline void display_row(const Field<float> &F, ptrdiff_t i, int n, unsigned char *data)
+	{
+		if (verify) display_checked(F, i, n, data); else current->display32(F, i, n, data);
+	}
+
+private:
+	static const Kernels *current;
+	template<typename T> EvolveRow<T> evolve() const;
+	template<typename T> static void evolve_checked(Field<T> &F, const Field<T> &F0, const Metric<T> &G, ptrdiff_t i, int n);
+	template<typename T> DisplayRow<T> display() const;
+	template<typename T> static void display_checked(const Field<T> &F, ptrdiff_t i, int n, unsigned char *data);
+};
+
+/** @} */
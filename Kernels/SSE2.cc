@@ -0,0 +1,83 @@
+#include "Kernels.h"
+#include "../Graphs/GL_Util.h" // for Display.h, its inline functions must not get the target options
+
+#if defined(__x86_64__) || defined(_M_X64)
+
+#ifdef __GNUC__
+#pragma GCC push_options
+#pragma GCC target("sse2")
+#endif
+#include <immintrin.h>
+
+namespace {
+
+struct V64 // 2 doubles
+{
+	typedef double T;
+	static const int N = 2;
+	__m128d v;
+
+	V64() { }
+	V64(__m128d x) : v(x) { }
+	explicit V64(double x) : v(_mm_set1_pd(x)) { }
+
+	static inline V64 load(const T *p) { return _mm_loadu_pd(p); }
+	static inline V64 load(const float *p) { return _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64((const __m128i*)p))); } // float metric
+	inline void store(T *p) const { _mm_storeu_pd(p, v); }
+
+	inline V64 operator+ (const V64 &x) const { return _mm_add_pd(v, x.v); }
+	inline V64 operator- (const V64 &x) const { return _mm_sub_pd(v, x.v); }
+	inline V64 operator* (const V64 &x) const { return _mm_mul_pd(v, x.v); }
+	inline V64 operator- () const { return _mm_mul_pd(v, _mm_set1_pd(-1.0)); }
+};
+
+struct V32 // 4 floats
+{
+	typedef float T;
+	static const int N = 4;
+	typedef __m128 M;
+	__m128 v;
+
+	V32() { }
+	V32(__m128 x) : v(x) { }
+	explicit V32(double x) : v(_mm_set1_ps((float)x)) { }
+
+	static inline V32 load(const T *p) { return _mm_loadu_ps(p); }
+	static inline V32 load(const double *p) { return _mm_movelh_ps(_mm_cvtpd_ps(_mm_loadu_pd(p)), _mm_cvtpd_ps(_mm_loadu_pd(p+2))); }
+	inline void store(T *p) const { _mm_storeu_ps(p, v); }
+
+	inline V32 operator+ (const V32 &x) const { return _mm_add_ps(v, x.v); }
+	inline V32 operator- (const V32 &x) const { return _mm_sub_ps(v, x.v); }
+	inline V32 operator* (const V32 &x) const { return _mm_mul_ps(v, x.v); }
+	inline V32 operator- () const { return _mm_mul_ps(v, _mm_set1_ps(-1.0f)); }
+	inline V32 operator/ (const V32 &x) const { return _mm_div_ps(v, x.v); }
+	inline M   operator< (const V32 &x) const { return _mm_cmplt_ps(v, x.v); }
+
+	inline V32 abs() const { return _mm_andnot_ps(_mm_set1_ps(-0.0f), v); }
+	inline V32 sqrt() const { return _mm_sqrt_ps(v); }
+	static inline V32 min(const V32 &a, const V32 &b) { return _mm_min_ps(a.v, b.v); }
+	static inline V32 max(const V32 &a, const V32 &b) { return _mm_max_ps(a.v, b.v); }
+	static inline V32 select(M m, const V32 &a, const V32 &b) { return _mm_or_ps(_mm_and_ps(m, a.v), _mm_andnot_ps(m, b.v)); }
+	static inline int  bits(M m) { return _mm_movemask_ps(m); }
+
+	static inline void store_rgba(const V32 &r, const V32 &g, const V32 &b, unsigned char *p)
+	{
+		__m128i c = _mm_or_si128(_mm_cvttps_epi32(r.v), _mm_slli_epi32(_mm_cvttps_epi32(g.v), 8));
+		c = _mm_or_si128(c, _mm_or_si128(_mm_slli_epi32(_mm_cvttps_epi32(b.v), 16), _mm_set1_epi32((int)0xFF000000)));
+		_mm_storeu_si128((__m128i*)p, c);
+	}
+};
+
+} // namespace
+
+#include "Evolve.h"
+#include "Display.h"
+
+extern const Kernels kernels_sse2;
+const Kernels kernels_sse2 = { "SSE2", V64::N, evolve_row<V64>, evolve_row<V32>, display_row<V32, double>, display_row<V32, float> };
+
+#ifdef __GNUC__
+#pragma GCC pop_options
+#endif
+
+#endif
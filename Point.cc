@@ -6,8 +6,11 @@ static inline double sqr(double x) { return x*x; }
 
 int Point::Y = 0;
 
-void Point::init(double x, double y, double Y)
+template<typename T>
+void Point::init(Field<T> &F, Metric<T> &G, ptrdiff_t i, double x, double y, double Y)
 {
+	typedef std::complex<T> C;
+
 	#if EQUATION==DIRAC
 
 	P2d v(38.0, 20.0);
@@ -15,17 +18,16 @@ void Point::init(double x, double y, double Y)
 	double r = 2.0*(x*x + y*y);
 	if (r < 0.25)
 	{
-		clear();
 		double s = sin(v.x*x + v.y*y), c = cos(v.x*x + v.y*y);
 		double f = 6.0 * exp(-1.0 / (1.0 - 4.0*r));
-		e0 = f*cnum(c, s);
-		e1 = 0.0;
-		e2 = v.y*f*cnum(-s,c);
-		e3 = v.x*f*cnum(-s, -c);
+		F.set(e0, i, C(f*cnum(c, s)));
+		F.set(e1, i, C(0));
+		F.set(e2, i, C(v.y*f*cnum(-s,c)));
+		F.set(e3, i, C(v.x*f*cnum(-s, -c)));
 	}
 	else
 	{
-		clear();
+		F.clear(i);
 	}
 	x += 0.3;
 
@@ -36,12 +38,12 @@ void Point::init(double x, double y, double Y)
 	{
 		double s = sin(123 * x), c = cos(123 * x);
 		double f = 1.5* M_E * exp(-1.0 / (1.0 - sqr((x-x0)/r)));
-		e = cnum(c, s) *f;
-		de = cnum(-s, c)*f;// cnum(c, s)*f;
+		F.set(e, i, C(cnum(c, s) *f));
+		F.set(de, i, C(cnum(-s, c)*f));// cnum(c, s)*f;
 	}
 	else
 	{
-		clear();
+		F.clear(i);
 	}
 	
 	#elif EQUATION==KLEINGORDON
@@ -52,20 +54,28 @@ void Point::init(double x, double y, double Y)
 	{
 		double s = sin(v.x*x + v.y*y), c = cos(v.x*x + v.y*y);
 		double f = 6.0 * exp(-1.0 / (1.0 - 4.0*r));
-		e = cnum(s, c) * f;
-		de = cnum(c, -s) * f;
+		F.set(e, i, C(cnum(s, c) * f));
+		F.set(de, i, C(cnum(c, -s) * f));
 	}
 	else
 	{
-		clear();
+		F.clear(i);
 	}
 	
 	#endif
 
-	init_g(x, y);
+	init_metric(G, i, x, y);
 }
 
-void Point::init_g(double x, double y)
+template<typename T>
+void Point::init_metric(Metric<T> &G, ptrdiff_t i, double x, double y)
+{
+	P3d g;
+	init_g(g, x, y);
+	G.set(i, g);
+}
+
+void Point::init_g(P3d &g, double x, double y)
 {
 	g.clear();
 	double r = std::hypot(x, y); // (0,0) is at center of screen
@@ -124,60 +134,52 @@ void Point::init_g(double x, double y)
 	g.z = sqrt(1.0 - g.z);
 }
 
-void Point::evolve(const Point *P)
+template<typename T>
+void Point::evolve(Field<T> &F, const Field<T> &P, const Metric<T> &G, ptrdiff_t i)
 {
-	g = P->g; // static gravity for now
+	typedef std::complex<T> C;
+	const P3<T> g = G(i); // static gravity for now
 
 	#if EQUATION==DIRAC //---------------------------------------
-	const double dt = 0.1 * g.z;
+	const T dt = T(0.1) * g.z;
 	//constexpr double dx = 1.0;
-	static constexpr cnum I(0.0, 1.0);
-	#if 1
-	static constexpr cnum c03 = -I, c02 = -1.0;
-	static constexpr cnum c12 =  0, c13 =  0.0;
-	static constexpr cnum c21 =  0, c20 = -1.0;
-	static constexpr cnum c30 =  I, c31 =  0.0;
-	static constexpr double m0 = 1.0, m1 = 0, m2 = 0, m3 = 0;
-	#else
-	static constexpr cnum c03 = -I, c02 = -1.0;
-	static constexpr cnum c12 =  I, c13 =  0.0;
-	static constexpr cnum c21 = -I, c20 = -1.0;
-	static constexpr cnum c30 =  I, c31 =  1.0;
-	static constexpr double m0 = 1.0, m1 = 1.0, m2 = 1.0, m3 = 1.0;
-	#endif
-	e0 += P->e0 - (c03*P->dfdx(3) - c02*P->dfdy(2) - m0*ix(P->e0)) * dt;
-	e1 += P->e1 - (c12*P->dfdx(2) - c13*P->dfdy(3) - m1*ix(P->e1)) * dt;
-	e2 += P->e2 - (c21*P->dfdx(1) - c20*P->dfdy(0) - m2*ix(P->e2)) * dt;
-	e3 += P->e3 - (c30*P->dfdx(0) - c31*P->dfdy(1) - m3*ix(P->e3)) * dt;
+	put(F, e0, i, P(e0, i) - (C(c03)*dfdx(P, g, i, 3) - C(c02)*dfdy(P, g, i, 2) - T(m0)*ix(P(e0, i))) * dt);
+	put(F, e1, i, P(e1, i) - (C(c12)*dfdx(P, g, i, 2) - C(c13)*dfdy(P, g, i, 3) - T(m1)*ix(P(e1, i))) * dt);
+	put(F, e2, i, P(e2, i) - (C(c21)*dfdx(P, g, i, 1) - C(c20)*dfdy(P, g, i, 0) - T(m2)*ix(P(e2, i))) * dt);
+	put(F, e3, i, P(e3, i) - (C(c30)*dfdx(P, g, i, 0) - C(c31)*dfdy(P, g, i, 1) - T(m3)*ix(P(e3, i))) * dt);
 
 	#elif EQUATION==MAXWELL
 
-	double dt = 0.1 * g.z;
-	constexpr double dx = 1.0;
+	const T dt = T(0.1) * g.z;
+	constexpr T dx = 1.0;
 
-	de = P->de + P->laplace() * (dt / (dx*dx));
-	e = P->e + de * dt;
+	C de_ = P(de, i) + laplace(P, g, i) * (dt / (dx*dx));
+	F.set(de, i, de_);
+	F.set(e, i, P(e, i) + de_ * dt);
 	
 	#elif EQUATION==KLEINGORDON
 	
-	double dt = 0.1 * g.z;
-	constexpr double dx = 1.0;
+	const T dt = T(0.1) * g.z;
+	constexpr T dx = 1.0;
 
 	#if 1
-	de = P->de + (P->laplace()/(dx*dx) - P->e) * dt;
-	e = P->e + de * dt;
+	C de_ = P(de, i) + (laplace(P, g, i)/(dx*dx) - P(e, i)) * dt;
+	F.set(de, i, de_);
+	F.set(e, i, P(e, i) + de_ * dt);
 	#elif 0
-	double v = sqr(g.x)+sqr(g.y);
+	const T one(1), half(0.5);
+	T v = g.x*g.x + g.y*g.y;
 	//double f2 = 1.0-sqr(g.x)-sqr(g.y);
-	cnum dde = P->laplace_orig()/(dx*dx) - P->e;
-	de = P->de * (1.0-v) + dde * dt * (1.0-v) + 
-		(P[-1].de * (1.0-g.x) + P[+1].de * (1.0+g.x))*sqr(g.x)*0.5 +
-		(P[-Y].de * (1.0-g.y) + P[+Y].de * (1.0+g.y))*sqr(g.y)*0.5;
-	e = P->e * (1.0-v) + de * dt * (1.0-v) + 
-		(P[-1].e * (1.0-g.x) + P[+1].e * (1.0+g.x))*sqr(g.x)*0.5 +
-		(P[-Y].e * (1.0-g.y) + P[+Y].e * (1.0+g.y))*sqr(g.y)*0.5;
+	C dde = laplace_orig(P, i)/(dx*dx) - P(e, i);
+	C de_ = P(de, i) * (one-v) + dde * dt * (one-v) + 
+		(P(de, i-1) * (one-g.x) + P(de, i+1) * (one+g.x))*(g.x*g.x)*half +
+		(P(de, i-Y) * (one-g.y) + P(de, i+Y) * (one+g.y))*(g.y*g.y)*half;
+	F.set(de, i, de_);
+	F.set(e, i, P(e, i) * (one-v) + de_ * dt * (one-v) + 
+		(P(e, i-1) * (one-g.x) + P(e, i+1) * (one+g.x))*(g.x*g.x)*half +
+		(P(e, i-Y) * (one-g.y) + P(e, i+Y) * (one+g.y))*(g.y*g.y)*half);
 	#else
-	e = (P[g.x < 0 ? -1 : 1].e * fabs(g.x) + (1.0-fabs(g.x)) * P->e);
+	F.set(e, i, P(e, i + (g.x < 0 ? -1 : 1)) * std::abs(g.x) + (T(1)-std::abs(g.x)) * P(e, i));
 
 	#endif
 	
@@ -187,29 +189,46 @@ void Point::evolve(const Point *P)
 
 int Point::vis = 0;
 
-void Point::display(unsigned char pixel[4])
+template<typename T>
+void Point::display(const Field<T> &F, ptrdiff_t i, unsigned char pixel[4])
 {
 	#if EQUATION==DIRAC
 	while (vis < 0) vis += 4;
-	switch (vis % 4)
-	{
-		case 0: if (!defined(e0)) memset(pixel, 42, 4); else hsl(e0, pixel); break;
-		case 1: if (!defined(e1)) memset(pixel, 42, 4); else hsl(e1, pixel); break;
-		case 2: if (!defined(e2)) memset(pixel, 42, 4); else hsl(e2, pixel); break;
-		case 3: if (!defined(e3)) memset(pixel, 42, 4); else hsl(e3, pixel); break;
-	}
+	const cnum z(F(vis % 4, i));
+	if (!defined(z)) memset(pixel, 42, 4); else ColorMap::color(z, pixel);
 	#else
 	while (vis < 0) vis += 2;
 	switch (vis % 2)
 	{
 		case 0:
-			if (!defined(e)) memset(pixel, 42, 4); else hsl(e, pixel);
+		{
+			const cnum z(F(e, i));
+			if (!defined(z)) memset(pixel, 42, 4); else ColorMap::color(z, pixel);
 			break;
+		}
 		case 1: // impulse
 		{
-			hsl(cnum(px(), py()), pixel);
+			ColorMap::color(cnum(px(F, i), py(F, i)), pixel);
 			break;
 		}
 	}
 	#endif
 }
+
+bool Point::display_local()
+{
+	#if EQUATION==DIRAC
+	return true;
+	#else
+	return (vis % 2 + 2) % 2 == 0; // the impulse looks at the neighbours
+	#endif
+}
+
+template void Point::init(Field<float>  &, Metric<float>  &, ptrdiff_t, double, double, double);
+template void Point::init(Field<double> &, Metric<double> &, ptrdiff_t, double, double, double);
+template void Point::init_metric(Metric<float>  &, ptrdiff_t, double, double);
+template void Point::init_metric(Metric<double> &, ptrdiff_t, double, double);
+template void Point::evolve(Field<float>  &, const Field<float>  &, const Metric<float>  &, ptrdiff_t);
+template void Point::evolve(Field<double> &, const Field<double> &, const Metric<double> &, ptrdiff_t);
+template void Point::display(const Field<float>  &, ptrdiff_t, unsigned char[4]);
+template void Point::display(const Field<double> &, ptrdiff_t, unsigned char[4]);
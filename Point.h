@@ -3,90 +3,163 @@
 #include "Graphs/Vector.h"
 
 //#define ZERO_BORDER
+//#define FLOAT_METRIC // store the metric in float, even when simulating in double
 
 #define DIRAC 0
 #define MAXWELL 1
 #define KLEINGORDON 2
 
+#ifndef EQUATION // can also be set with scons --equation=...
 #define EQUATION DIRAC
 //#define EQUATION MAXWELL
 //#define EQUATION KLEINGORDON
+#endif
 
 #if EQUATION==DIRAC
 #define POINT_SIZE 4
-#define e0 F[0]
-#define e1 F[1]
-#define e2 F[2]
-#define e3 F[3]
 #else
 #define POINT_SIZE 2
-#define e  F[0]
-#define de F[1]
 #endif
 
+/**
+ * One time slice of all fields, stored as structure of arrays: every component has a real and an
+ * imaginary plane of its own. Component k of the point at index i is (re(k)[i], im(k)[i]).
+ * All planes share the row pitch Point::Y. T is the scalar type of the simulation (float or double).
+ */
+template<typename T> struct Field
+{
+	typedef std::complex<T> C;
+	static const int PLANES = 2*POINT_SIZE;
+	static const int TILE = 64; // points per block for the activity flags
+	T *plane[PLANES]; // plane[2k] = re(F_k), plane[2k+1] = im(F_k)
+	uint8_t *active;  // one flag per row and block of TILE points, cleared only if the block is zero (NULL: not tracked)
+
+	inline T *re(int k) const { return plane[2*k]; }
+	inline T *im(int k) const { return plane[2*k+1]; }
+
+	inline C operator()(int k, ptrdiff_t i) const { return C(plane[2*k][i], plane[2*k+1][i]); }
+	inline void set(int k, ptrdiff_t i, const C &z) { plane[2*k][i] = z.real(); plane[2*k+1][i] = z.imag(); }
+	inline void add(int k, ptrdiff_t i, const C &z) { plane[2*k][i] += z.real(); plane[2*k+1][i] += z.imag(); }
+	inline void clear(ptrdiff_t i) { for (T *p : plane) p[i] = T(0); }
+	inline void clear(ptrdiff_t i, int n) { for (T *p : plane) memset(p + i, 0, n * sizeof(T)); }
+
+	/// Are all components of the n points from i within eps of zero? NaNs are not.
+	inline bool quiet(ptrdiff_t i, int n, T eps) const
+	{
+		for (const T *p : plane)
+		for (int j = 0; j < n; ++j)
+		{
+			if (!(std::abs(p[i+j]) <= eps)) return false;
+		}
+		return true;
+	}
+};
+
+/**
+ * The (static) metric, one read-only plane per component: (x,y,z) = (g_x, g_y, sqrt(1-g_t))
+ * It is stored as S and converted to T when read.
+ */
+template<typename T> struct Metric
+{
+	#ifdef FLOAT_METRIC
+	typedef float S;
+	#else
+	typedef T S;
+	#endif
+	S *x, *y, *z;
+
+	inline P3<T> operator()(ptrdiff_t i) const { return P3<T>((T)x[i], (T)y[i], (T)z[i]); }
+	inline void set(ptrdiff_t i, const P3d &g) { x[i] = (S)g.x; y[i] = (S)g.y; z[i] = (S)g.z; }
+};
+
+/**
+ * The model. A point is addressed by its index into the planes of a Field, so
+ * i-1 is the left neighbour, i+1 the right, i-Y above and i+Y below.
+ * Everything that touches the fields is instantiated for float and double.
+ */
 struct Point
 {
 	static const int OVERLAP = 1; // how far into neighbouring points does a point's calculation read?
 	static const int MOD_OVERLAP = 0; // how far does it modify?
 	static int vis;
-	static int Y; // P[-1] is the left neighbour, P[1] the right, P[-Y] above and P[Y] below.
-	
-	cnum F[POINT_SIZE]; // whatever fields the model uses
-	P3d  g; // (x,y,z) = (g_x, g_y, sqrt(1-g_t))
+	static int Y; // row pitch of the planes
 
-	inline void clear()
-	{
-		g.clear();
-		memset(F, 0, POINT_SIZE*sizeof(cnum));
-	}
+	#if EQUATION==DIRAC
+	enum { e0, e1, e2, e3 }; // field components
 
-	void init(double x, double y, double Y); // x in [-1,1], y in [-Y,Y], Y = h/w
-	void evolve(const Point *p0); // p0 is the point from last iteration
-	void display(unsigned char pixel[4]); // Point --> RGBA
-	void operator+= (const Point &p)
-	{
-		assert(MOD_OVERLAP > 0); // otherwise there should be no need to call this
-		for (int i = 0; i < POINT_SIZE; ++i) F[i] += p.F[i];
-	}
+	// coefficients of the Dirac equation (shared with the row kernels)
+	static constexpr cnum I = cnum(0.0, 1.0);
+	#if 1
+	static constexpr cnum c03 = -I, c02 = -1.0;
+	static constexpr cnum c12 =  0, c13 =  0.0;
+	static constexpr cnum c21 =  0, c20 = -1.0;
+	static constexpr cnum c30 =  I, c31 =  0.0;
+	static constexpr double m0 = 1.0, m1 = 0, m2 = 0, m3 = 0;
+	#else
+	static constexpr cnum c03 = -I, c02 = -1.0;
+	static constexpr cnum c12 =  I, c13 =  0.0;
+	static constexpr cnum c21 = -I, c20 = -1.0;
+	static constexpr cnum c30 =  I, c31 =  1.0;
+	static constexpr double m0 = 1.0, m1 = 1.0, m2 = 1.0, m3 = 1.0;
+	#endif
+	#else
+	enum { e, de };
+	#endif
+
+	template<typename T> static void init(Field<T> &F, Metric<T> &G, ptrdiff_t i, double x, double y, double Y); // x in [-1,1], y in [-Y,Y], Y = h/w
+	template<typename T> static void init_metric(Metric<T> &G, ptrdiff_t i, double x, double y); // only the G part of init
+	template<typename T> static void evolve(Field<T> &F, const Field<T> &F0, const Metric<T> &G, ptrdiff_t i); // F0 is the field from last iteration
+	template<typename T> static void display(const Field<T> &F, ptrdiff_t i, unsigned char pixel[4]); // Point --> RGBA
+	static bool display_local(); // does display(F, i) read nothing but point i (depends on vis)?
 
 private:
-	void init_g(double x, double y);
+	static void init_g(P3d &g, double x, double y);
+
+	/// Write the new value of F_k at i. Unless neighbours modify it too, nothing has to be accumulated.
+	template<typename T> static inline void put(Field<T> &F, int k, ptrdiff_t i, const std::complex<T> &z)
+	{
+		if (MOD_OVERLAP > 0) F.add(k, i, z); else F.set(k, i, z);
+	}
 
 	// modified differential operators for QG (constant factors like 1/dx^2 ignored):
-	inline cnum laplace(int i = 0) const
+	template<typename T> static inline std::complex<T> laplace(const Field<T> &F, const P3<T> &g, ptrdiff_t i, int k = 0)
 	{
+		const T one(1), four(4);
 		return
-		this[-1].F[i] * (1.0-g.x) +
-		this[+1].F[i] * (1.0+g.x) +
-		this[-Y].F[i] * (1.0-g.y) +
-		this[+Y].F[i] * (1.0+g.y) - F[i] * 4.0;
+		F(k, i-1) * (one-g.x) +
+		F(k, i+1) * (one+g.x) +
+		F(k, i-Y) * (one-g.y) +
+		F(k, i+Y) * (one+g.y) - F(k, i) * four;
 	}
-	inline cnum laplace_orig(int i = 0) const
+	template<typename T> static inline std::complex<T> laplace_orig(const Field<T> &F, ptrdiff_t i, int k = 0)
 	{
+		const T four(4);
 		return
-		this[-1].F[i] +
-		this[+1].F[i] +
-		this[-Y].F[i] +
-		this[+Y].F[i] - F[i] * 4.0;
+		F(k, i-1) +
+		F(k, i+1) +
+		F(k, i-Y) +
+		F(k, i+Y) - F(k, i) * four;
 	}
 	// first order (df/dx, df/dy):
-	inline cnum dfdx(int i = 0) const
+	template<typename T> static inline std::complex<T> dfdx(const Field<T> &F, const P3<T> &g, ptrdiff_t i, int k = 0)
 	{
-		return 
-		(this[+1].F[i] * (1.0+g.x) - this[-1].F[i] * (1.0-g.x)) * 0.5 - F[i] * g.x;
+		const T one(1), half(0.5);
+		return
+		(F(k, i+1) * (one+g.x) - F(k, i-1) * (one-g.x)) * half - F(k, i) * g.x;
 	}
-	inline cnum dfdy(int i = 0) const
+	template<typename T> static inline std::complex<T> dfdy(const Field<T> &F, const P3<T> &g, ptrdiff_t i, int k = 0)
 	{
-		return 
-		(this[+Y].F[i] * (1.0+g.y) - this[-Y].F[i] * (1.0-g.y)) * 0.5 - F[i] * g.y;
+		const T one(1), half(0.5);
+		return
+		(F(k, i+Y) * (one+g.y) - F(k, i-Y) * (one-g.y)) * half - F(k, i) * g.y;
 	}
 	// impulse (for display):
-	inline double px(int i = 0)
+	template<typename T> static inline double px(const Field<T> &F, ptrdiff_t i, int k = 0)
 	{
-		return sp(ix(this[-1].F[i] - this[+1].F[i]), F[i]) * 0.5;
+		return sp(ix(cnum(F(k, i-1) - F(k, i+1))), cnum(F(k, i))) * 0.5;
 	}
-	inline double py(int i = 0)
+	template<typename T> static inline double py(const Field<T> &F, ptrdiff_t i, int k = 0)
 	{
-		return sp(ix(this[-Y].F[i] - this[+Y].F[i]), F[i]) * 0.5;
+		return sp(ix(cnum(F(k, i-Y) - F(k, i+Y))), cnum(F(k, i))) * 0.5;
 	}
 };
@@ -0,0 +1,97 @@
+#include "Simulation.h"
+
+Simulation::Simulation(Graph &g)
+: graph(g)
+, pending(1) // the initial state
+, quit(false)
+{ }
+
+Simulation::~Simulation()
+{
+	stop();
+}
+
+void Simulation::start()
+{
+	if (running()) return;
+	quit = false;
+	thread = std::thread([this]() { run(); });
+}
+
+void Simulation::stop()
+{
+	if (!running()) return;
+	{
+		std::lock_guard<std::mutex> l(lock);
+		quit = true;
+	}
+	wake.notify_one();
+	thread.join();
+
+	// nobody else is left to run them
+	for (auto &f : queue) f(graph);
+	queue.clear();
+}
+
+void Simulation::post(std::function<void(Graph &)> f)
+{
+	{
+		std::lock_guard<std::mutex> l(lock);
+		queue.push_back(std::move(f));
+	}
+	wake.notify_one();
+}
+
+void Simulation::frame()
+{
+	{
+		std::lock_guard<std::mutex> l(lock);
+		pending = 1; // several requests before the next frame are one
+	}
+	wake.notify_one();
+}
+
+void Simulation::run()
+{
+	std::vector<std::function<void(Graph &)>> todo;
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> l(lock);
+			wake.wait(l, [this]() { return quit || !queue.empty() || pending > 0 || graph.animating(); });
+			if (quit) return;
+			todo.swap(queue);
+		}
+		for (auto &f : todo) f(graph);
+		todo.clear();
+
+		{
+			std::lock_guard<std::mutex> l(lock);
+			if (pending > 0) --pending;
+			else if (!graph.animating()) continue; // only posted changes
+		}
+
+		try
+		{
+			graph.update();
+		}
+		catch (const std::bad_alloc &)
+		{
+			#ifdef DEBUG
+			std::cerr << "allocation failed!" << std::endl;
+			#endif
+			continue;
+		}
+		catch (...)
+		{
+			#ifdef DEBUG
+			std::cerr << "exception in update()!" << std::endl;
+			#endif
+			continue;
+		}
+
+		if (on_frame) on_frame(graph);
+		graph.swap_image(frames.back()); // update redims image() every frame, so it can have any buffer
+		frames.publish();
+	}
+}
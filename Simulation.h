@@ -0,0 +1,53 @@
+#pragma once
+#include "Graph.h"
+#include "Utility/TripleBuffer.h"
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Runs Graph::update on a thread of its own, frame after frame while the graph is animating, and
+ * publishes every finished image through a TripleBuffer. The window only draws the newest one, so the
+ * simulation runs as fast as it can and the window stays responsive even if a frame takes seconds.
+ *
+ * While it runs, the graph belongs to the simulation thread: everything that reads or changes it (or
+ * the settings it depends on, like Point::vis) goes through post() and runs between two frames.
+ */
+class Simulation
+{
+public:
+	explicit Simulation(Graph &g);
+	~Simulation(); // stops
+
+	void start();
+	void stop(); ///< Waits for the current frame, the graph can be used directly again afterwards
+	bool running() const { return thread.joinable(); }
+
+	/// Runs f on the simulation thread before the next frame (or right away, if there is none coming)
+	void post(std::function<void(Graph &)> f);
+
+	/// One more frame, even if the graph is not animating (what glutPostRedisplay used to do)
+	void frame();
+
+	/// Consumer side: picks up the newest image. @return false if there was none since the last call.
+	bool fresh() { return frames.update(); }
+	const GL_Image &image() const { return frames.front(); } ///< The image from the last fresh()
+
+	/// Called on the simulation thread after every frame (for the recorder), set it before start()
+	std::function<void(const Graph &)> on_frame;
+
+private:
+	void run();
+
+	Graph &graph;
+	std::thread thread;
+	TripleBuffer<GL_Image> frames;
+
+	std::mutex lock; // for everything below
+	std::condition_variable wake;
+	std::vector<std::function<void(Graph &)>> queue;
+	int  pending; // frames to do even when not animating
+	bool quit;
+};
@@ -0,0 +1,120 @@
+#include "Numa.h"
+#include <algorithm>
+#include <fstream>
+#include <string>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+#ifdef __linux__
+
+/// Parses sysfs cpu lists like "0-3,8-11"
+static std::vector<int> read_list(const std::string &path)
+{
+	std::vector<int> v;
+	std::ifstream f(path);
+	std::string s;
+	if (!std::getline(f, s)) return v;
+	size_t i = 0;
+	while (i < s.size())
+	{
+		size_t e = s.find(',', i); if (e == std::string::npos) e = s.size();
+		std::string r = s.substr(i, e - i);
+		size_t d = r.find('-');
+		int a = atoi(r.c_str()), b = d == std::string::npos ? a : atoi(r.c_str() + d + 1);
+		for (int c = a; c <= b; ++c) v.push_back(c);
+		i = e + 1;
+	}
+	return v;
+}
+
+struct Topology
+{
+	std::vector<int> node; // node[cpu]
+	std::vector<int> cpus; // allowed cpus, by node
+	int n_nodes;
+
+	Topology() : n_nodes(0)
+	{
+		for (int k : read_list("/sys/devices/system/node/online"))
+		{
+			std::vector<int> l = read_list("/sys/devices/system/node/node" + std::to_string(k) + "/cpulist");
+			n_nodes = std::max(n_nodes, k + 1);
+			for (int c : l)
+			{
+				if (c >= (int)node.size()) node.resize(c + 1, -1);
+				node[c] = k;
+			}
+		}
+		if (!n_nodes) n_nodes = 1;
+
+		cpu_set_t set; CPU_ZERO(&set);
+		if (sched_getaffinity(0, sizeof(set), &set) == 0)
+		{
+			for (int c = 0; c < CPU_SETSIZE; ++c) if (CPU_ISSET(c, &set)) cpus.push_back(c);
+		}
+		if (cpus.empty()) cpus.push_back(0);
+		std::stable_sort(cpus.begin(), cpus.end(), [this](int a, int b) { return node_of(a) < node_of(b); });
+	}
+
+	int node_of(int c) const { return c >= 0 && c < (int)node.size() ? node[c] : -1; }
+};
+
+static const Topology &topology()
+{
+	static Topology t; // before any pinning, so cpus is everything we were started with
+	return t;
+}
+
+int Numa::nodes() { return topology().n_nodes; }
+int Numa::node_of_cpu(int cpu) { return topology().node_of(cpu); }
+const std::vector<int> &Numa::cpus() { return topology().cpus; }
+
+bool Numa::pin(int cpu)
+{
+	cpu_set_t set; CPU_ZERO(&set);
+	if (cpu < 0) for (int c : cpus()) CPU_SET(c, &set); else CPU_SET(cpu, &set);
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+size_t Numa::page_size() { return (size_t)sysconf(_SC_PAGESIZE); }
+
+size_t Numa::page_nodes(const void *p, size_t bytes, std::vector<int> &nodes)
+{
+	const size_t ps = page_size();
+	const uintptr_t a = (uintptr_t)p & ~(uintptr_t)(ps-1), b = ((uintptr_t)p + bytes + ps-1) & ~(uintptr_t)(ps-1);
+	const size_t n = (b - a) / ps;
+	nodes.assign(n, -1);
+	std::vector<void*> pages(n);
+	for (size_t i = 0; i < n; ++i) pages[i] = (void*)(a + i*ps);
+
+	// move_pages with no target nodes only reports where the pages are
+	const size_t batch = 4096;
+	for (size_t i = 0; i < n; i += batch)
+	{
+		size_t m = std::min(batch, n - i);
+		if (syscall(SYS_move_pages, 0, m, &pages[i], NULL, &nodes[i], 0) != 0) return n; // leaves them at -1
+		for (size_t j = i; j < i + m; ++j) if (nodes[j] < 0) nodes[j] = -1; // -ENOENT etc.
+	}
+	return n;
+}
+
+#else
+
+int Numa::nodes() { return 1; }
+int Numa::node_of_cpu(int cpu) { return -1; }
+const std::vector<int> &Numa::cpus() { static std::vector<int> v(1, 0); return v; }
+bool Numa::pin(int cpu) { return false; }
+size_t Numa::page_size() { return 4096; }
+size_t Numa::page_nodes(const void *p, size_t bytes, std::vector<int> &nodes)
+{
+	const size_t n = (bytes + page_size() - 1) / page_size();
+	nodes.assign(n, -1);
+	return n;
+}
+
+#endif
@@ -0,0 +1,33 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+
+/**
+ * @defgroup Numa NUMA Topology
+ * @{
+ * What little we need to know about the machine's NUMA layout. Only implemented for Linux, where it
+ * reads sysfs and asks the kernel where pages are. Everywhere else there is one node and pages are
+ * never found.
+ */
+
+namespace Numa
+{
+	int nodes();              ///< Number of NUMA nodes (1 if unknown)
+	int node_of_cpu(int cpu); ///< -1 if unknown
+
+	/// All CPUs that we may run on, ordered by node, so consecutive threads share a node
+	const std::vector<int> &cpus();
+
+	/// Pins the calling thread to a single CPU, or unpins it for cpu < 0. @return false if that failed.
+	bool pin(int cpu);
+
+	/**
+	 * Looks up the node of every page in [p, p+bytes). Pages that were never touched or cannot be
+	 * queried get -1. @return the number of pages
+	 */
+	size_t page_nodes(const void *p, size_t bytes, std::vector<int> &nodes);
+
+	size_t page_size();
+}
+
+/** @} */
@@ -1,17 +1,125 @@
 #include "ThreadMap.h"
+#include "Numa.h"
 
 #include <cassert>
 #include <iostream>
+#include <fstream>
 #include <atomic>
+#include <set>
 
 #include <thread>
 #include <mutex>
 #include <condition_variable>
-
-#ifdef DEBUG
-//#define TASK_DEBUG
+#include <chrono>
+#ifdef _MSC_VER
+#include <immintrin.h>
 #endif
 
+//----------------------------------------------------------------------------------------------------------------------
+// Tracing
+//----------------------------------------------------------------------------------------------------------------------
+
+/// One complete event: a unit that ran (unit = the WorkLayer's name), a wait for work or a whole task
+struct TraceEvent
+{
+	const char *name; // interned, so it outlives the layer
+	uint64_t    t0, t1;
+	enum Kind : uint8_t { UNIT, WAIT, TASK } kind;
+};
+
+/// Every thread records into its own buffer, which never grows, so recording costs two clock reads
+struct TraceBuffer
+{
+	static const size_t CAPACITY = 1 << 18;
+	int    tid;
+	size_t used, dropped;
+	std::unique_ptr<TraceEvent[]> events;
+
+	TraceBuffer(int tid) : tid(tid), used(0), dropped(0), events(new TraceEvent[CAPACITY]) { }
+
+	void add(const char *name, uint64_t t0, uint64_t t1, TraceEvent::Kind kind)
+	{
+		if (used == CAPACITY) { ++dropped; return; }
+		events[used++] = TraceEvent{name, t0, t1, kind};
+	}
+};
+
+static std::atomic<bool> trace_on(false);
+static std::mutex trace_lock; // for everything below
+static std::vector<std::unique_ptr<TraceBuffer>> trace_buffers;
+static thread_local TraceBuffer *trace_buffer = NULL;
+
+static inline uint64_t trace_clock()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static TraceBuffer &thread_trace()
+{
+	if (!trace_buffer)
+	{
+		std::lock_guard<std::mutex> l(trace_lock);
+		trace_buffers.emplace_back(new TraceBuffer((int)trace_buffers.size()));
+		trace_buffer = trace_buffers.back().get();
+	}
+	return *trace_buffer;
+}
+
+static const char *trace_intern(const std::string &name)
+{
+	static std::set<std::string> names;
+	std::lock_guard<std::mutex> l(trace_lock);
+	return names.insert(name).first->c_str();
+}
+
+void Task::trace(bool on){ trace_on = on; }
+bool Task::tracing(){ return trace_on; }
+
+static void json_string(std::ostream &os, const char *s)
+{
+	os << '"';
+	for (; *s; ++s)
+	{
+		if (*s == '"' || *s == '\\') os << '\\';
+		if ((unsigned char)*s >= 32) os << *s;
+	}
+	os << '"';
+}
+
+bool Task::write_trace(const std::string &path)
+{
+	std::ofstream os(path);
+	if (!os) return false;
+
+	std::lock_guard<std::mutex> l(trace_lock);
+	uint64_t t_min = UINT64_MAX;
+	for (auto &b : trace_buffers) for (size_t i = 0; i < b->used; ++i) t_min = std::min(t_min, b->events[i].t0);
+
+	os << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+	bool first = true;
+	char buf[128];
+	for (auto &b : trace_buffers)
+	{
+		os << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << b->tid
+		   << ",\"args\":{\"name\":\"" << (b->tid ? "worker " : "thread ") << b->tid << "\"}}";
+		first = false;
+		for (size_t i = 0; i < b->used; ++i)
+		{
+			const TraceEvent &e = b->events[i];
+			static const char *cat[] = {"unit", "wait", "task"};
+			os << ",\n{\"name\":";
+			json_string(os, e.name);
+			snprintf(buf, sizeof(buf), ",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+			         cat[e.kind], b->tid, (e.t0 - t_min) * 1e-3, (e.t1 - e.t0) * 1e-3);
+			os << buf;
+		}
+		if (b->dropped) std::cerr << "Trace buffer of thread " << b->tid << " was full, " << b->dropped << " events dropped" << std::endl;
+		b->used = b->dropped = 0;
+	}
+	os << "\n]}\n";
+	return (bool)os;
+}
+
 //----------------------------------------------------------------------------------------------------------------------
 // WorkUnit
 //----------------------------------------------------------------------------------------------------------------------
@@ -23,200 +131,266 @@ bool WorkUnit::assign()
 	return true;
 }
 
+void WorkUnit::release()
+{
+	if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1) layer->task->push(this);
+}
+
 void WorkUnit::finish()
 {
 	assert(state == State::ASSIGNED);
 	state = State::DONE;
+	for (int i = 0; i < n_successors; ++i) successors[i]->release();
 	layer->finish(this);
 }
 
-void WorkUnit::start(int i)
+//----------------------------------------------------------------------------------------------------------------------
+// WorkLayer
+//----------------------------------------------------------------------------------------------------------------------
+
+WorkLayer::WorkLayer(const std::string &name, Task *t, WorkLayer *down, int space_, int range_below_, int offset_)
+: name(name), task(t), below(down), above(NULL), space(space_), range_below(range_below_), offset(offset_)
+, unfinished(0), busy_ns(0), cyclic(false), trace_name(trace_intern(name))
 {
-	//std::condition_variable foo;
+	if (space < 0) space = 0;
 	
-	// check the items in range_below
-	if (layer->below && layer->range_below != 0)
+	if (below) below->above = this;
+		
+	if (!task->layer0) task->layer0 = this;
+	task->linked = false;
+}
+
+void WorkLayer::added(WorkUnit *u)
+{
+	units.push_back(u);
+	++unfinished;
+	task->linked = false;
+}
+
+void WorkLayer::set_cyclic()
+{
+	cyclic = true;
+	task->linked = false;
+}
+
+WorkLayer::~WorkLayer()
+{
+	for (WorkUnit *u : units) u->~WorkUnit(); // the memory belongs to the task
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+template<class E> void WorkLayer::edges(E edge) const
+{
+	const int n = (int)units.size();
+
+	// the units in range_below (range_below < 0 is not an edge, see finish)
+	if (below && range_below > 0)
 	{
-		WorkLayer *last = layer->below;
+		WorkLayer *last = below;
 		int lastn = (int)last->units.size();
-		for (;;)
+		for (int i = 0; i < n; ++i)
 		{
-			if (layer->range_below < 0)
+			for (int j = 0; j < range_below; ++j)
 			{
-				if (last->done()) break;
+				int k = offset + i + j;
+				if (cyclic) k = (k % lastn + lastn) % lastn;
+				if (k >= 0 && k < lastn) edge(last->units[k], units[i]);
 			}
-			else
-			{
-				bool wait = false;
-				for (int j = 0; j < layer->range_below; ++j)
-				{
-					int k = layer->offset + i + j;
-					if (k >= 0 && k < lastn && !last->units[k]->done())
-					{
-						#ifdef TASK_DEBUG
-						layer->task->start_logging();
-						std::cerr << "Unit " << i << " / " << layer->work_order(i) << " of layer " << layer->name <<
-						" waiting on unit " << k << " / " << last->work_order(k) << " below (" << last->name << ")" << std::endl;
-						layer->task->finish_logging();
-						#endif
-						
-						wait = true;
-						break;
-					}
-				}
-				if (!wait) break;
-			}
-			
-
-			//usleep(500 + arc4random_uniform(200)); // waiting for the lower level could take some time
-			#ifdef USE_PTHREADS
-			pthread_yield();
-			#else
-			std::this_thread::yield();
-			#endif
 		}
 	}
-	
-	// check that all items before (in the layer's work order) this one that intersect its space range are done
-	if (layer->space > 0)
+
+	// the neighbours in the space range that come before a unit in the layer's work order
+	if (space > 0)
 	{
-		int iw = layer->work_order(i);
-		for (;;)
+		for (int i = 0; i < n; ++i)
 		{
-			bool wait = false;
-			
-			for (int j = -layer->space; j <= layer->space; ++j)
+			int iw = work_order(i);
+			for (int j = -space; j <= space; ++j)
 			{
-				if (j == 0) continue;
-				int u = i+j; if (layer->cyclic && u > 0) u %= layer->units.size();
-				int k = layer->work_order(u);
-				assert(k != iw);
-				if (k >= 0 && k < iw && !layer->units[u]->done())
-				{
-					#ifdef TASK_DEBUG
-					layer->task->start_logging();
-					std::cerr << "Unit " << i << " / " << layer->work_order(i) << " of layer " << layer->name <<
-					" waiting on neighbour " << u << " / " << k << std::endl;
-					layer->task->finish_logging();
-					#endif
-					
-					wait = true;
-					break;
-				}
+				int u = i+j;
+				if (cyclic) u = (u % n + n) % n;
+				if (u == i || u < 0 || u >= n) continue;
+				if (work_order(u) < iw) edge(units[u], units[i]);
 			}
-			if (!wait) break;
-			
-
-			#ifdef USE_PTHREADS
-			pthread_yield();
-			#else
-			std::this_thread::yield();
-			std::this_thread::sleep_for(std::chrono::nanoseconds(100));
-			//usleep(100 + arc4random_uniform(100)); // waiting for neighbours should almost never happen
-			#endif
 		}
 	}
 }
 
+void WorkLayer::finish(WorkUnit *u)
+{
+	assert(u->state == WorkUnit::State::DONE);
+	if (unfinished.fetch_sub(1, std::memory_order_acq_rel) == 1 && above && above->range_below < 0)
+	{
+		for (WorkUnit *v : above->units) v->release();
+	}
+	if (task->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) task->wake(true);
+}
+
 //----------------------------------------------------------------------------------------------------------------------
-// WorkLayer
+// Task
 //----------------------------------------------------------------------------------------------------------------------
 
-WorkLayer::WorkLayer(const std::string &name, Task *t, WorkLayer *down, int space_, int range_below_, int offset_)
-: name(name), task(t), below(down), above(NULL), space(space_), range_below(range_below_), offset(offset_)
-, next_todo(0), unfinished(0), cyclic(false)
+static inline void cpu_relax()
 {
-	if (space < 0) space = 0;
-	
-	if (below) below->above = this;
-		
-	if (!task->layer0)
-	{
-		task->layer0 = this;
-		task->active = this;
-	}
+	#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	__builtin_ia32_pause();
+	#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	_mm_pause();
+	#endif
 }
 
-WorkLayer::~WorkLayer()
+static std::atomic<uint64_t> n_waits(0), n_parks(0), n_steals(0), blocked_ns(0);
+
+TaskStats Task::stats()
 {
-	for (WorkUnit *u : units) delete u;
+	TaskStats s;
+	s.waits   = n_waits;
+	s.parks   = n_parks;
+	s.steals  = n_steals;
+	s.blocked = (double)blocked_ns * 1e-9;
+	return s;
 }
 
-//----------------------------------------------------------------------------------------------------------------------
+double Task::busy() const
+{
+	double t = 0.0;
+	for (WorkLayer *layer = layer0; layer; layer = layer->above) t += layer->busy();
+	return t;
+}
 
-void WorkLayer::finish(WorkUnit *u)
+static thread_local Task   *current_task  = NULL; // task that the calling thread is working on
+static thread_local int     current_queue = 0;    // and its queue in that task
+static thread_local uint32_t rng = 0x9E3779B9u;   // for picking victims
+static thread_local int     pinned_cpu = -1;      // where the thread is pinned to
+
+static std::atomic<bool> pin_setting(false);
+
+void Task::pin_threads(bool f){ pin_setting = f; }
+bool Task::pinned_threads(){ return pin_setting; }
+
+int Task::home_cpu(int q)
 {
-	if (!acquire(true)){ assert(false); return; }
-	assert(u->state == WorkUnit::State::DONE);
-	--unfinished; // atomic
-	//OSAtomicDecrement32Barrier(&unfinished);
-	release();
+	const std::vector<int> &cpus = Numa::cpus();
+	return cpus[q % cpus.size()];
 }
 
-WorkUnit *WorkLayer::get(int &i)
+int Task::home_node(int i, int n, int n_threads)
+{
+	if (!pin_setting || n <= 0 || n_threads < 1) return -1;
+	return Numa::node_of_cpu(home_cpu((int)((long long)i * n_threads / n)));
+}
+
+void Task::push(WorkUnit *u)
+{
+	push(u, u->home >= 0 ? u->home : current_task == this ? current_queue : 0);
+}
+
+void Task::push(WorkUnit *u, int q)
 {
-	int n = (int)units.size();
-	if (next_todo >= n) return NULL;
-	if (!acquire(true)) return NULL;
-	
-	if (next_todo >= n)
 	{
-		release();
-		return NULL;
+		std::lock_guard<std::mutex> l(queues[q].lock);
+		queues[q].push_back(u);
 	}
+	++n_ready;
+	wake(false);
+}
 
-	i = index_order(next_todo);
-	WorkUnit *u = units[i];
-	if (!u->assign())
+void Task::wake(bool all)
+{
+	if (!sleepers) return;
 	{
-		assert(false);
-		release();
-		return NULL;
+		// a sleeper is either not waiting yet, then it will see the new state when it checks
+		// under the lock, or it is waiting and gets woken
+		std::lock_guard<std::mutex> l(park_lock);
 	}
-	++next_todo;
-	release();
-	return u;
+	if (all) parked.notify_all(); else parked.notify_one();
 }
 
-//----------------------------------------------------------------------------------------------------------------------
-// Task
-//----------------------------------------------------------------------------------------------------------------------
-
-WorkUnit *Task::get(int &i)
+WorkUnit *Task::steal()
 {
-	WorkLayer *a = active;
-	while (a)
+	// pinned threads look at their neighbours first, which are on the same node (see Numa::cpus)
+	rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+	const bool near = pin_setting;
+	for (int k = 1, v0 = (int)(rng % n_queues); k <= n_queues; ++k)
 	{
-		WorkUnit *u = a->get(i);
-		if (u) return u;
-		
-		// active layer is done, move up
-		// threadsafe variant of if (a == active) active = a->above
-		
-		//OSAtomicCompareAndSwapPtr((void*)a, (void*)a->above, (void**)&active);
-		if (std::atomic_compare_exchange_weak(&active, &a, a->above)) a = a->above;
-		// otherwise acxw loads a = active
+		int v = near ? current_queue + (k & 1 ? (k+1)/2 : -k/2) : v0 + k;
+		Queue &q = queues[(v % n_queues + n_queues) % n_queues];
+		if (&q == &queues[current_queue]) continue;
+		std::lock_guard<std::mutex> l(q.lock);
+		if (WorkUnit *u = q.pop_front()) return u;
 	}
 	return NULL;
 }
 
-void *Task::run_thread(void *task_)
+WorkUnit *Task::pop()
 {
-	Task *task = (Task*)task_;
-	try
+	Queue &mine = queues[current_queue];
+	for (;;)
 	{
 		WorkUnit *u;
-		int       i;
-		while (u = task->get(i))
 		{
-			u->start(i);
+			std::lock_guard<std::mutex> l(mine.lock);
+			u = mine.pop_back();
+		}
+		if (!u && (u = steal())) ++n_steals;
+		if (u)
+		{
+			--n_ready;
+			return u;
+		}
+		if (!remaining) return NULL;
+		wait_ready();
+	}
+}
+
+void Task::wait_ready()
+{
+	// the next unit is usually about to get ready, so spin for a bit before going to sleep
+	auto t0 = std::chrono::steady_clock::now();
+	const uint64_t tt = trace_on ? trace_clock() : 0;
+	++n_waits;
+	for (int k = 0; k < 256 && !n_ready && remaining; ++k) cpu_relax();
+	if (!n_ready && remaining)
+	{
+		++n_parks;
+		std::unique_lock<std::mutex> l(park_lock);
+		++sleepers;
+		parked.wait(l, [this]() { return n_ready > 0 || !remaining; });
+		--sleepers;
+	}
+	blocked_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+	if (tt) thread_trace().add("waiting", tt, trace_clock(), TraceEvent::WAIT);
+}
+
+void Task::run_thread(Task *task, int index)
+{
+	current_task  = task;
+	current_queue = index % task->n_queues;
+
+	const int cpu = pin_setting ? home_cpu(index) : -1;
+	if (cpu != pinned_cpu && Numa::pin(cpu)) pinned_cpu = cpu;
+	try
+	{
+		if (trace_on || task->timed)
+		{
+			TraceBuffer *trace = trace_on ? &thread_trace() : NULL;
+			while (WorkUnit *u = task->pop())
+			{
+				u->assign();
+				uint64_t t0 = trace_clock();
+				u->work();
+				uint64_t t1 = trace_clock();
+				if (trace) trace->add(u->layer->trace_name, t0, t1, TraceEvent::UNIT);
+				if (task->timed) u->layer->busy_ns.fetch_add(t1 - t0, std::memory_order_relaxed);
+				u->finish();
+			}
+		}
+		else while (WorkUnit *u = task->pop())
+		{
+			u->assign();
 			u->work();
 			u->finish();
-			#ifdef USE_PTHREADS
-			pthread_yield();
-			#else
-			std::this_thread::yield();
-			#endif
 		}
 	}
 	catch(...)
@@ -224,61 +398,199 @@ void *Task::run_thread(void *task_)
 		// if threads start throwing exceptions, we should set some failure bits and cancel everybody
 		assert(false);
 	}
-	return NULL;
+	current_task = NULL;
 }
 
-void Task::run(int n_threads)
+//----------------------------------------------------------------------------------------------------------------------
+// ThreadPool
+//----------------------------------------------------------------------------------------------------------------------
+
+/**
+ * Long-lived worker threads for Task::run. They sleep on a condition variable between tasks, so
+ * creating threads is a one-time cost and an idle program uses no CPU. The pool grows to the largest
+ * n_threads that was asked for and the threads get joined at exit.
+ */
+class ThreadPool
 {
-	if (n_threads <= 1)
+public:
+	static ThreadPool &shared()
 	{
-		run_thread(this);
-		return;
+		static ThreadPool pool;
+		return pool;
 	}
 
-#ifndef USE_PTHREADS
-	
-	std::vector<std::thread> threads;
-	for (int i = 0; i < n_threads; ++i)
+	/// Runs task on n_threads threads, the calling thread being one of them. Returns when all are done.
+	void run(Task &task, int n_threads)
 	{
-		threads.emplace_back(Task::run_thread, this);
+		std::lock_guard<std::mutex> serial(submit); // one task at a time
+		const int n = n_threads - 1;
+		{
+			std::unique_lock<std::mutex> l(m);
+			while ((int)threads.size() < n)
+			{
+				int i = (int)threads.size();
+				threads.emplace_back([this, i]() { worker(i); });
+			}
+			current = &task;
+			wanted = running = n;
+			++generation;
+		}
+		wake.notify_all();
+
+		Task::run_thread(&task, 0);
+
+		std::unique_lock<std::mutex> l(m);
+		done.wait(l, [this]() { return running == 0; });
+		current = NULL;
 	}
 
-	if (threads.empty())
+private:
+	ThreadPool() : current(NULL), generation(0), wanted(0), running(0), quit(false) { }
+	~ThreadPool()
 	{
-		assert(false);
-		run_thread(this);
-		return;
+		{
+			std::lock_guard<std::mutex> l(m);
+			quit = true;
+		}
+		wake.notify_all();
+		for (auto &t : threads) t.join();
 	}
 
-	for (auto &t : threads)
+	void worker(int i)
 	{
-		t.join();
+		uint64_t seen = 0;
+		std::unique_lock<std::mutex> l(m);
+		for (;;)
+		{
+			// threads i >= wanted sit this task out
+			wake.wait(l, [&]() { return quit || (generation != seen && i < wanted); });
+			if (quit) return;
+			seen = generation;
+			Task *task = current;
+
+			l.unlock();
+			Task::run_thread(task, i + 1);
+			l.lock();
+
+			if (--running == 0) done.notify_all();
+		}
 	}
 
-#else
+	std::mutex               submit;  ///< Serializes calls to run
+	std::mutex               m;       ///< Lock for everything below
+	std::condition_variable  wake;    ///< Workers wait for a new task on this
+	std::condition_variable  done;    ///< run() waits for the workers on this
+	std::vector<std::thread> threads;
+	Task    *current;    ///< The task being run
+	uint64_t generation; ///< Incremented for every task
+	int      wanted;     ///< Number of workers that take part in the current task
+	int      running;    ///< Number of workers still busy with it
+	bool     quit;
+};
 
-	std::vector<pthread_t> threads;
-	for (int i = 0; i < n_threads; ++i)
+//----------------------------------------------------------------------------------------------------------------------
+
+void *Task::allocate(size_t n, size_t align)
+{
+	assert(align && align <= 64 && !(align & (align-1)));
+	char *p = (char*)(((uintptr_t)arena_next + align-1) & ~(uintptr_t)(align-1));
+	if (!arena_next || p + n > arena_end)
+	{
+		const size_t block = std::max(n, (size_t)1 << 16);
+		p = (char*)aligned_alloc(64, (block + 63) & ~(size_t)63);
+		if (!p) throw std::bad_alloc();
+		arena.push_back(p);
+		arena_end = p + block;
+	}
+	arena_next = p + n;
+	return p;
+}
+
+void Task::link()
+{
+	// count, then fill the successor lists (an earlier link's lists just stay in the arena)
+	total = n_initial = 0;
+	for (WorkLayer *layer = layer0; layer; layer = layer->above)
 	{
-		pthread_t ID;
-		if (0 == pthread_create(&ID, NULL, Task::run_thread, this))
+		bool barrier = layer->below && layer->range_below < 0 && !layer->below->units.empty();
+		for (WorkUnit *u : layer->units)
 		{
-			threads.push_back(ID);
+			u->preds = barrier ? 1 : 0; // counted as one, see WorkLayer::finish
+			u->n_successors = 0;
 		}
+		total += (int)layer->units.size();
 	}
-	
-	if (threads.empty())
+	for (WorkLayer *layer = layer0; layer; layer = layer->above)
 	{
-		assert(false);
-		run_thread(this);
-		return;
+		layer->edges([](WorkUnit *u, WorkUnit *v) { ++u->n_successors; ++v->preds; });
 	}
-	
-	for (auto ID : threads)
+	for (WorkLayer *layer = layer0; layer; layer = layer->above)
 	{
-		pthread_join(ID, NULL);
+		for (WorkUnit *u : layer->units)
+		{
+			u->successors = u->n_successors ? (WorkUnit**)allocate(u->n_successors * sizeof(WorkUnit*), alignof(WorkUnit*)) : NULL;
+			u->n_successors = 0;
+			if (!u->preds) ++n_initial;
+		}
 	}
-	
-#endif
+	for (WorkLayer *layer = layer0; layer; layer = layer->above)
+	{
+		layer->edges([](WorkUnit *u, WorkUnit *v) { u->successors[u->n_successors++] = v; });
+	}
+	linked = true;
 }
 
+void Task::run(int n_threads)
+{
+	if (!linked) link();
+	if (!total) return;
+
+	const uint64_t tt = trace_on ? trace_clock() : 0;
+
+	// reset everything from the last run
+	if (n_threads < 1) n_threads = 1;
+	if (n_threads > INT16_MAX) n_threads = INT16_MAX; // see WorkUnit::home
+	if (n_queues != n_threads)
+	{
+		n_queues = n_threads;
+		queues.reset(new Queue[n_queues]);
+	}
+	for (int q = 0; q < n_queues; ++q)
+	{
+		if ((int)queues[q].ring.size() < total) queues[q].ring.resize(total);
+		queues[q].head = queues[q].tail = 0;
+	}
+	const bool homes = pin_setting;
+	for (WorkLayer *layer = layer0; layer; layer = layer->above)
+	{
+		const int n = (int)layer->units.size();
+		layer->unfinished = n;
+		layer->busy_ns = 0;
+		for (int k = 0; k < n; ++k)
+		{
+			WorkUnit *u = layer->units[k];
+			u->state = WorkUnit::State::TODO;
+			u->pending = u->preds;
+			u->home = homes ? (int16_t)((long long)k * n_queues / n) : -1;
+		}
+	}
+	n_ready = 0;
+	remaining = total;
+	sleepers = 0;
+
+	// hand out the initially ready units in contiguous runs, so neighbouring strips share a thread
+	int j = 0;
+	for (WorkLayer *layer = layer0; layer; layer = layer->above)
+	{
+		for (WorkUnit *u : layer->units)
+		{
+			if (!u->preds) push(u, u->home >= 0 ? u->home : (int)((long long)j * n_queues / n_initial));
+			if (!u->preds) ++j;
+		}
+	}
+
+	if (n_threads <= 1) run_thread(this, 0);
+	else ThreadPool::shared().run(*this, n_threads);
+
+	if (tt) thread_trace().add("task", tt, trace_clock(), TraceEvent::TASK);
+}
@@ -3,20 +3,56 @@
 #include <vector>
 #include <cassert>
 #include <string>
-#include <functional>
 #include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <type_traits>
+#include <new>
+#include <cstddef>
 #include "Mutex.h"
 
 class WorkLayer;
 class Task;
+class ThreadPool;
 
 /**
  * @defgroup ThreadMaps Thread Maps
  * @{
  */
 
-// Task class handles the thread_data 
-typedef std::function<void(void)> Work;
+/**
+ * What a WorkUnit runs: any void() callable, stored inline like in a std::function, but with a fixed
+ * capacity instead of going to the heap for larger captures. Lambdas that capture more than CAPACITY
+ * bytes do not compile (capture a pointer to the data instead).
+ */
+class Work
+{
+public:
+	static const size_t CAPACITY = 144;
+
+	template<class F> Work(F &&f)
+	{
+		typedef typename std::decay<F>::type G;
+		static_assert(sizeof(G) <= CAPACITY, "Work: capture too large");
+		static_assert(alignof(G) <= alignof(std::max_align_t), "Work: capture over-aligned");
+		new (buf) G(std::forward<F>(f));
+		call    = [](void *p) { (*(G*)p)(); };
+		destroy = NULL;
+		if (!std::is_trivially_destructible<G>::value) destroy = [](void *p) { ((G*)p)->~G(); };
+	}
+	~Work(){ if (destroy) destroy(buf); }
+
+	Work(const Work &) = delete;
+	Work &operator= (const Work &) = delete;
+
+	void operator()(){ call(buf); }
+
+private:
+	alignas(std::max_align_t) unsigned char buf[CAPACITY];
+	void (*call)(void *);
+	void (*destroy)(void *);
+};
 
 /**
  * Part of a WorkLayer. Distinguished from its siblings in the same layer by the data in its work lambda.
@@ -24,14 +60,17 @@ typedef std::function<void(void)> Work;
  * i1 <= i < i2 and the units are more or less independent and can often run in parallel.
  * 
  * The execution lifecycle is like this:
- * -# The unit starts in State::TODO
- * -# The layer calls assign and state switches to State::ASSIGNED
- * -# WorkUnit::start is called which waits until all units that this one depends on are WorkUnit::done()
- * -# WorkLayer::work runs for the unit, passing thread_data (cf. Task class) of the thread that runs it
- * -# WorkUnit::finish sets state to State::DONE
+ * -# The unit starts in State::TODO, with pending = preds, the number of units it depends on
+ * -# Every predecessor that finishes decrements pending, the one that gets it to zero puts the unit
+ *    into the task's ready queue (units without predecessors start out there)
+ * -# A thread takes it from the queue, state switches to State::ASSIGNED and the work runs
+ * -# WorkUnit::finish sets state to State::DONE and releases the successors
+ *
+ * Units live in their task's arena, each on cache lines of its own, so threads updating the state
+ * and pending counts of neighbouring units do not invalidate each other's lines.
  */
 
-class WorkUnit
+class alignas(64) WorkUnit
 {
 	friend class WorkLayer;
 	friend class Task;
@@ -42,22 +81,28 @@ private:
 	WorkUnit &operator= (const WorkUnit &) = delete;
 
 	/// Units are created by the WorkLayer that contains them
-	WorkUnit(WorkLayer *layer, const Work &w) : work(w), layer(layer), state(State::TODO) { }
+	template<class F> WorkUnit(WorkLayer *layer, F &&w)
+	: state(State::TODO), home(-1), pending(0), preds(0), n_successors(0), successors(NULL), layer(layer), work(std::forward<F>(w)) { }
 	
-	enum class State : int
+	enum class State : uint8_t
 	{
 		TODO     =  0, ///< ready to go
 		ASSIGNED =  1, ///< assigned, possibly running
 		DONE     =  2  ///< done, but can be reactivated
 	};
 
-	volatile State    state;
-	Work              work;  ///< Called to do the actual work
-	WorkLayer * const layer; ///< The containing WorkLayer
-	
+	std::atomic<State> state;
+	int16_t            home;         ///< Queue that it goes into when it gets ready, -1 for the releasing thread's
+	std::atomic<int>   pending;      ///< Number of predecessors that are not done yet
+	int                preds;        ///< Number of predecessors, pending starts at this
+	int                n_successors;
+	WorkUnit         **successors;   ///< Units that count this one in their preds (in the task's arena)
+	WorkLayer * const  layer;        ///< The containing WorkLayer
+	Work               work;         ///< Called to do the actual work
+
+	void release();            ///< One predecessor is done
 	bool  assign();            ///< Set state to ASSIGNED
-	void   start(int myIndex); ///< Wait for dependencies to finish
-	void  finish();            ///< Set state to DONE and notify the layer
+	void  finish();            ///< Set state to DONE and release the successors
 	bool    done() const{ return state == State::DONE; }
 };
 
@@ -66,13 +111,15 @@ private:
  * Typically one major step of an algorithm. Divided into an array of work units that run in parallel.
  * Layers are stacked on top of each other. The entire stack is the Task.
  *
- * Work layers can handle three types of dependencies between work units:
+ * Work layers can handle three types of dependencies between work units (which Task::run turns into
+ * predecessor counts, so units run as soon as their own dependencies are met, even if lower layers are
+ * still busy elsewhere):
  * -# This layer needs the entire layer below to finish before it can run any work units
  * -# Every work unit needs its pendant on the layer below (and possible the neighbours of that unit) to finish
  *    before it starts running.
  * -# No work unit can run in parallel with its direct neighbours (or an entire range of neighbours)
  *
- * The work that a work layer does is passed as a std::function which should contain all needed data as well.
+ * The work that a work layer does is passed as a closure (see Work) which should contain all needed data as well.
  *
  * Work units have two natural orderings: On the one hand they are elements of an array - call that index_order.
  * On the other hand they can be sorted by the neighbour dependencies: 0, 1+space, 2+2space, ..., wrapping around.
@@ -98,65 +145,45 @@ public:
 	 *              It is guaranteed, that units[0], units[1+space], [2+2space], etc run first.
 	 * @param range_below  Unit i is blocked by below->units[i+offset+0] ... [i+offset+range_below-1].
 	 *                     If range_below < 0, this needs the entire layer below to finish first.
+	 *                     In cyclic layers, the range wraps around the ends of the layer below.
 	 * @param offset see range_below
 	 * @see cyclic
 	 */
 	WorkLayer(const std::string &name, Task *t, WorkLayer *down, int space = 0, int range_below = 0, int offset = 0);
 	~WorkLayer();
 
-	WorkUnit *add_unit(const Work &work)
-	{
-		WorkUnit *u = new WorkUnit(this, work);
-		units.push_back(u);
-		++unfinished;
-		return u;
-	}
+	template<class F> WorkUnit *add_unit(F &&work); ///< work is anything that converts to Work
 
-	bool done() const{ return !unfinished; }
+	bool done() const{ return !unfinished.load(std::memory_order_acquire); }
 
-	void set_cyclic(){ cyclic = true; }
+	void set_cyclic();
+
+	/// Seconds spent in the units of the last run, summed over all threads (only if the task is timed)
+	double busy() const { return 1e-9 * (double)busy_ns.load(std::memory_order_relaxed); }
 
-	/**
-	 * Tries to get the next work unit assigned and waits for its dependencies to finish before returning.
-	 * @param its_index On success will be the index (in units array) of the returned unit.
-	 * @return The next work unit, in state State::ASSIGNED or NULL on failure (no unit is TODO).
-	 */
-	WorkUnit *get(int &its_index);
-	
 private:
-	
-	/**
-	 * Locks the layer, so its state can be updated.
-	 * @param block If true, the call will block until the lock is acquired, otherwise it returns immediately.
-	 * @return True if the lock was acquired.
-	 */
-	bool acquire(bool block)
-	{
-		return (block ? (lock.lock(), true) : lock.try_lock());
-	}
-	
-	/**
-	 * Release the lock. Must only be called after a successful call to acquire.
-	 */
-	void release(){ lock.unlock(); }
-	
+
+	template<class E> void edges(E edge) const; ///< Calls edge(u, v) for every unit u of this or the layer below that v depends on
+	void added(WorkUnit *u);
+
 	/**
-	 * Call u->finish() while locked and decrement the 'unfinished' counter.
+	 * Called by u->finish(), decrements the 'unfinished' counter. The last unit releases the
+	 * layer above, if that waits for all of this one.
 	 */
 	void finish(WorkUnit *u);
 	
 	WorkLayer *above, *below;     ///< Doubly linked list.
 	Task      *task;              ///< Task that this belongs to.
-	Mutex      lock;              ///< Lock for all state updates.
 
 	bool cyclic; ///< First and last units are considered neighbours if cyclic is true.
 	
-	volatile int32_t     next_todo;  ///< in work_order
 	std::atomic<int32_t> unfinished; ///< Upper bound for the number of units with !done()
-	std::vector<WorkUnit*> units;
+	std::atomic<uint64_t> busy_ns;   ///< see busy()
+	std::vector<WorkUnit*> units;    ///< Contiguous in the task's arena unless other layers add units in between
 	int space;                    ///< Every unit blocks the next and previous space units
 	int range_below, offset;      ///< For getting blocked by the lower Layer
 	std::string name;             ///< For printing/debugging
+	const char *trace_name;       ///< name, but lives as long as the trace (see Task::trace)
 
 	
 	/* Some work order examples:
@@ -203,13 +230,31 @@ private:
 };
 
 
+/**
+ * Cumulative waiting statistics over all tasks
+ */
+struct TaskStats
+{
+	uint64_t waits;   ///< Number of times a thread found no ready unit while the task was not done
+	uint64_t parks;   ///< Number of those where it had to go to sleep
+	uint64_t steals;  ///< Number of units that were taken from another thread's queue
+	double   blocked; ///< Total time spent waiting for ready units, in seconds (summed over all threads)
+};
+
 /**
  * Tasks consist of a lattice of work units, grouped into layers, that are run by a thread pool.
+ *
+ * Every thread has a queue of ready units. Units released by a finishing unit go to the queue of the
+ * thread that ran it, which then picks up the most recent one first. So a strip tends to stay on the
+ * same core from one layer to the next. Threads that run out of work steal the oldest units from
+ * other queues, starting at a random one.
  */
 
 class Task
 {
+	friend class WorkUnit;
 	friend class WorkLayer;
+	friend class ThreadPool;
 	
 public:
 	/**
@@ -223,7 +268,7 @@ public:
 	 * @param finish Before the threads terminate, they call finish with the same data pointer.
 	 * @param info Something that gets passed to every thread's setup call.
 	 */
-	Task() : active(NULL), layer0(NULL)
+	Task() : layer0(NULL), linked(false), timed(false), total(0), n_initial(0), n_queues(0), n_ready(0), remaining(0), sleepers(0)
 	{
 	}
 	
@@ -236,35 +281,91 @@ public:
 			w = w->above;
 			delete tmp;
 		}
+		for (char *b : arena) free(b);
 	}
 	
-	void run(int n_threads); ///< Creates worker threads and runs the entire task.
+	/**
+	 * Runs the entire task on n_threads threads from a shared pool (the caller being one of them).
+	 * A task can be run any number of times. Unless layers or units were added in between, later runs
+	 * reuse everything from the first one and do not allocate memory.
+	 */
+	void run(int n_threads);
+
+	static TaskStats stats();
+
+	/// Lets the layers measure how busy they are in every run (two clock reads per unit), see WorkLayer::busy
+	void time_layers(bool f) { timed = f; }
+	double busy() const; ///< Sum of all layers' busy()
+
+	/**
+	 * Pins thread i of every task to the i-th CPU of Numa::cpus() (the calling thread being thread 0)
+	 * and gives every unit a home: unit k of n in a layer is always queued for thread k*n_threads/n.
+	 * Layers that split the same rows into units the same way then run every strip on the same CPU,
+	 * from the first touch of its memory on. Threads that run out of work still steal, preferably
+	 * from their neighbours. Off by default.
+	 */
+	static void pin_threads(bool f);
+	static bool pinned_threads();
+
+	/// NUMA node that unit i of n goes to with pinned threads, -1 if not pinned or unknown
+	static int home_node(int i, int n, int n_threads);
+
+	/**
+	 * While tracing is on, every thread records which layer's units it ran when, how long it waited
+	 * for work and how long every Task::run took, into a fixed-size buffer of its own (events that do
+	 * not fit are dropped). write_trace saves all of it as Chrome trace JSON, for chrome://tracing or
+	 * ui.perfetto.dev, and empties the buffers. Call it between tasks, not while one is running.
+	 */
+	static void trace(bool on);
+	static bool tracing();
+	static bool write_trace(const std::string &path);
 	
 private:
-	WorkUnit *get(int &its_index); ///< @return The next work unit in State::TODO or NULL if the task is done.
-	
-	std::atomic<WorkLayer*> active; ///< Lowest layer with work units to be run.
-	WorkLayer *layer0;           ///< Lowest layer.
-	
-	bool acquire(WorkLayer *layer) /// Tries to lock the task while layer is still the active layer. Does not block.
-	{
-		if (active != layer) return false;
-		if (!lock.try_lock()) return false;
-		if (active != layer)
-		{
-			lock.unlock();
-			return false;
-		}
-		return true;
-	}
-	void release() /// Release the lock.
+	WorkLayer *layer0; ///< Lowest layer.
+	bool linked;       ///< Are preds and successors up to date?
+	bool timed;        ///< see time_layers
+	int  total;        ///< Number of units in all layers
+	int  n_initial;    ///< Number of units without predecessors
+
+	/**
+	 * The units and their successor lists are bump allocated from blocks that are freed with the
+	 * task, so building a task does not go to the heap for every unit.
+	 */
+	std::vector<char*> arena;
+	char *arena_next = NULL, *arena_end = NULL;
+	void *allocate(size_t n, size_t align = 64); ///< align must be a power of two <= 64
+
+	void link(); ///< Turns the dependencies of all layers into preds and successors
+
+	void push(WorkUnit *u);        ///< u is ready to run
+	void push(WorkUnit *u, int q); ///< into queues[q]
+	WorkUnit *pop();               ///< Waits for a ready unit. @return NULL if the task is done.
+	WorkUnit *steal();
+	void wait_ready();             ///< Spins for a bit, then sleeps until a unit is queued or the task is done.
+	void wake(bool all);
+
+	static void run_thread(Task *task, int index); ///< Called by every thread, index = number of its queue.
+	static int  home_cpu(int q);
+
+	struct alignas(64) Queue ///< The owner works at the back, thieves take from the front
 	{
-		lock.unlock();
-	}
+		std::mutex             lock;
+		std::vector<WorkUnit*> ring; ///< Sized to hold all units of the task, so it cannot overflow
+		size_t                 head = 0, tail = 0; ///< ring[head...tail-1], modulo its size
 
-	static void *run_thread(void *task); ///< Called by every thread.
+		void      push_back(WorkUnit *u){ ring[tail++ % ring.size()] = u; }
+		WorkUnit *pop_back() { return head == tail ? NULL : ring[--tail % ring.size()]; }
+		WorkUnit *pop_front(){ return head == tail ? NULL : ring[head++ % ring.size()]; }
+	};
+	std::unique_ptr<Queue[]> queues;
+	int                      n_queues;
+
+	std::atomic<int>        n_ready;   ///< Number of queued units, for spinning and sleeping
+	std::atomic<int>        remaining; ///< Number of units that are not done
+	std::atomic<int>        sleepers;  ///< Threads waiting on parked
+	std::mutex              park_lock;
+	std::condition_variable parked;    ///< Signalled when a unit gets ready and when the task is done
 
-	Mutex lock; ///< Lock for modifying the task's state
 	#ifdef DEBUG
 	Mutex logger_lock; ///< Lock for writing to stdout or stderr or logfiles
 public:
@@ -273,5 +374,12 @@ public:
 	#endif
 };
 
+template<class F> WorkUnit *WorkLayer::add_unit(F &&work)
+{
+	WorkUnit *u = new (task->allocate(sizeof(WorkUnit))) WorkUnit(this, std::forward<F>(work));
+	added(u);
+	return u;
+}
+
 /** @} */
 
@@ -0,0 +1,42 @@
+#pragma once
+#include <atomic>
+
+/**
+ * Hands values (frames) from one producer thread to one consumer thread without locking and without
+ * either of them ever waiting: the producer writes into back() and publishes it, the consumer picks up
+ * the newest published value with update() and reads it in front(). Values the consumer did not pick up
+ * in time get overwritten, so it always sees the newest one and the producer never gets throttled.
+ *
+ * The third buffer is the one in the middle, which is exchanged atomically with either of the others.
+ */
+template<typename T> class TripleBuffer
+{
+public:
+	TripleBuffer() : front_(0), back_(1), middle(2) { }
+	TripleBuffer(const TripleBuffer &) = delete;
+	TripleBuffer &operator=(const TripleBuffer &) = delete;
+
+	/// Producer side: the buffer to write the next value into
+	T &back() { return buf[back_]; }
+
+	/// Producer side: makes back() the newest value and gets a new back()
+	void publish() { back_ = middle.exchange(back_ | FRESH, std::memory_order_acq_rel) & INDEX; }
+
+	/// Consumer side: moves the newest value into front(). @return false if nothing new was published.
+	bool update()
+	{
+		if (!(middle.load(std::memory_order_relaxed) & FRESH)) return false;
+		front_ = middle.exchange(front_, std::memory_order_acq_rel) & INDEX;
+		return true;
+	}
+
+	/// Consumer side: the value from the last successful update()
+	const T &front() const { return buf[front_]; }
+
+private:
+	enum { INDEX = 3, FRESH = 4 }; // middle = index | FRESH if it has not been picked up yet
+	T buf[3];
+	alignas(64) int front_; // consumer only
+	alignas(64) int back_;  // producer only
+	alignas(64) std::atomic<int> middle;
+};
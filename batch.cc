@@ -0,0 +1,160 @@
+// wplot-batch: runs the simulation without a window, for benchmarks and machines without a display.
+// Build with 'scons batch', run wplot-batch -h for the options.
+
+#include "Graph.h"
+#include "Point.h"
+#include "Graphs/GL_Util.h"
+#include "Kernels/Kernels.h"
+#include "Utility/ThreadMap.h"
+#include <chrono>
+
+#if EQUATION==DIRAC
+static const char *equation = "dirac";
+#elif EQUATION==MAXWELL
+static const char *equation = "maxwell";
+#else
+static const char *equation = "kleingordon";
+#endif
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  -s WxH      grid size (default 512x512)\n"
+		"  -r N WxH    continue on a WxH grid after frame N, resampling the state (can be repeated)\n"
+		"  -d WxH      size of the written frames, larger grids get box filtered (default: the grid size)\n"
+		"  -e NAME     equation, only checked: this one is built for %s (scons --equation=NAME for the others)\n"
+		"  -n FRAMES   number of frames to compute (default 100)\n"
+		"  -t TZ       timezoom, evolve steps per frame (default 1)\n"
+		"  -a MS       automatic timezoom, as many steps as fit into MS milliseconds per frame\n"
+		"  -j THREADS  number of threads (default: one per core)\n"
+		"  -v VIS      visualization mode, 0-7 (default 0)\n"
+		"  -f          simulate in float instead of double\n"
+		"  -c          reference colors: hsl for every pixel, no color table or vector kernels\n"
+		"  -o PREFIX   write the frames as PREFIX00000.ppm, PREFIX00001.ppm, ...\n"
+		"  -k K        with -o, only write every K-th frame (default 1)\n"
+		"  -S          print timing and thread statistics\n"
+		"  -T N FILE   save a Chrome trace of the first N frames (see Task::trace)\n",
+		argv0, equation);
+}
+
+/// The image is stored bottom row first, like glDrawPixels wants it
+static bool write_ppm(const GL_Image &im, const std::string &path)
+{
+	FILE *f = fopen(path.c_str(), "wb");
+	if (!f) return false;
+	const unsigned w = im.w(), h = im.h();
+	fprintf(f, "P6\n%u %u\n255\n", w, h);
+	std::vector<unsigned char> row(3 * w);
+	for (unsigned y = h; y-- > 0; )
+	{
+		const unsigned char *p = im.data().data() + 4 * (size_t)w * y;
+		for (unsigned x = 0; x < w; ++x, p += 4) memcpy(&row[3*x], p, 3);
+		fwrite(row.data(), 1, row.size(), f);
+	}
+	return fclose(f) == 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int w = 512, h = 512, dw = 0, dh = 0, frames = 100, tz = 1, threads = 0, vis = 0, every = 1, trace_frames = 0;
+	bool single = false, stats = false;
+	double budget = 0.0;
+	std::string prefix, trace_path;
+	struct Regrid { int frame, w, h; };
+	std::vector<Regrid> regrid;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string a = argv[i];
+		auto next = [&]() -> const char* { if (i + 1 >= argc) { usage(argv[0]); exit(1); } return argv[++i]; };
+		if      (a == "-s") { if (sscanf(next(), "%dx%d", &w, &h) != 2) { usage(argv[0]); return 1; } }
+		else if (a == "-d") { if (sscanf(next(), "%dx%d", &dw, &dh) != 2) { usage(argv[0]); return 1; } }
+		else if (a == "-r")
+		{
+			Regrid r; r.frame = atoi(next());
+			if (sscanf(next(), "%dx%d", &r.w, &r.h) != 2 || r.w < 1 || r.h < 1) { usage(argv[0]); return 1; }
+			regrid.push_back(r);
+		}
+		else if (a == "-e")
+		{
+			const char *e = next();
+			if (strcmp(e, equation) != 0)
+			{
+				fprintf(stderr, "This wplot-batch simulates %s, rebuild with scons --equation=%s\n", equation, e);
+				return 1;
+			}
+		}
+		else if (a == "-n") frames = atoi(next());
+		else if (a == "-t") tz = atoi(next());
+		else if (a == "-a") budget = 1e-3 * atof(next());
+		else if (a == "-j") threads = atoi(next());
+		else if (a == "-v") vis = atoi(next());
+		else if (a == "-f") single = true;
+		else if (a == "-c") ColorMap::precise = true;
+		else if (a == "-o") prefix = next();
+		else if (a == "-k") every = std::max(1, atoi(next()));
+		else if (a == "-S") stats = true;
+		else if (a == "-T") { trace_frames = atoi(next()); trace_path = next(); }
+		else { usage(argv[0]); return a == "-h" ? 0 : 1; }
+	}
+	if (!dw || !dh) { dw = w; dh = h; }
+	if (w < 1 || h < 1 || dw < 1 || dh < 1 || frames < 0 || tz < 1 || vis < 0 || vis > 7) { usage(argv[0]); return 1; }
+
+	Point::vis = vis;
+	Graph g;
+	g.zoom(1);
+	g.timezoom(tz);
+	g.auto_timezoom(budget);
+	g.threads(threads);
+	g.single_precision(single);
+	g.grid(w, h);
+	g.resize(dw, dh);
+
+	// the first update only sets up the initial state
+	g.update();
+	if (g.image().empty()) { fprintf(stderr, "Could not allocate a %dx%d grid\n", w, h); return 1; }
+
+	if (trace_frames > 0) Task::trace(true);
+	auto t0 = std::chrono::steady_clock::now();
+	double t_io = 0.0, steps = 0.0;
+	for (int f = 0; f < frames; ++f)
+	{
+		bool regridded = false;
+		for (const Regrid &r : regrid) if (r.frame == f) { g.grid(r.w, r.h); regridded = true; } // the next update only resamples
+		if (!regridded) steps += g.timezoom(); // before update changes it
+		g.update();
+
+		if (f + 1 == trace_frames)
+		{
+			Task::trace(false);
+			if (!Task::write_trace(trace_path)) fprintf(stderr, "Could not write %s\n", trace_path.c_str());
+		}
+
+		if (!prefix.empty() && f % every == 0)
+		{
+			auto t1 = std::chrono::steady_clock::now();
+			char n[16]; snprintf(n, sizeof(n), "%05d.ppm", f);
+			if (!write_ppm(g.image(), prefix + n)) { fprintf(stderr, "Could not write %s%s\n", prefix.c_str(), n); return 1; }
+			t_io += std::chrono::duration<double>(std::chrono::steady_clock::now() - t1).count();
+		}
+	}
+	if (Task::tracing())
+	{
+		Task::trace(false);
+		if (!Task::write_trace(trace_path)) fprintf(stderr, "Could not write %s\n", trace_path.c_str());
+	}
+	const double dt = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count() - t_io;
+
+	if (stats)
+	{
+		TaskStats s = Task::stats();
+		printf("%s, %dx%d (shown at 1/%d), %s, %d threads, %s kernels\n", equation, w, h, g.downsampling(), single ? "float" : "double", g.threads(), Kernels::get().name);
+		printf("%d frames, %.0f steps in %.3fs: %.3f ms/frame, %.1f steps/s, %.1f Mpoints/s\n",
+		       frames, steps, dt, frames ? 1e3 * dt / frames : 0.0, steps / dt, steps * w * h / dt * 1e-6);
+		if (budget > 0.0) printf("automatic timezoom: %d at the end, %.1f steps/s lately\n", g.timezoom(), g.steps_per_second());
+		printf("%llu waits for work, %llu of them slept, %.3fs blocked in total, %llu units stolen\n",
+		       (unsigned long long)s.waits, (unsigned long long)s.parks, s.blocked, (unsigned long long)s.steals);
+	}
+	return 0;
+}
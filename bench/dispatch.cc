@@ -0,0 +1,44 @@
+// Unit dispatch throughput of ThreadMap: runs tasks of empty work units on 1, 2, 4, ... threads.
+// Build with 'scons bench', run as bench/dispatch [max threads] [units per layer] [layers]
+
+#include "../Utility/ThreadMap.h"
+#include <chrono>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+
+static double run(int threads, int units, int layers, int reps)
+{
+	auto t0 = std::chrono::steady_clock::now();
+	for (int r = 0; r < reps; ++r)
+	{
+		Task task;
+		WorkLayer *layer = NULL;
+		for (int l = 0; l < layers; ++l)
+		{
+			// every unit waits for its pendant below, like the stacked layers in Graph::update
+			layer = new WorkLayer("bench", &task, layer, 0, l ? 1 : 0);
+			for (int i = 0; i < units; ++i) layer->add_unit([]() { });
+		}
+		task.run(threads);
+	}
+	std::chrono::duration<double> dt = std::chrono::steady_clock::now() - t0;
+	return (double)units * layers * reps / dt.count();
+}
+
+int main(int argc, char *argv[])
+{
+	int max_threads = argc > 1 ? atoi(argv[1]) : (int)std::thread::hardware_concurrency();
+	int units  = argc > 2 ? atoi(argv[2]) : 256;
+	int layers = argc > 3 ? atoi(argv[3]) : 16;
+	if (max_threads < 1) max_threads = 1;
+
+	printf("%d units x %d layers per task\n", units, layers);
+	for (int n = 1; ; n = std::min(2*n, max_threads))
+	{
+		run(n, units, layers, 10); // warm up the pool
+		printf("%3d threads: %8.2f M units/s\n", n, run(n, units, layers, 200) * 1e-6);
+		if (n == max_threads) break;
+	}
+	return 0;
+}
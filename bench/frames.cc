@@ -0,0 +1,70 @@
+// Checks that Graph::update does not allocate once the task graph of a frame (the Plan) is cached:
+// for every combination of the settings below, runs a few frames to warm up and then counts the calls
+// to operator new over many more. The image gets swapped out after every frame, like Simulation does
+// with its three buffers. Automatic timezoom is left out, every new tz is a new plan.
+// Build with 'scons bench', run as bench/frames [frames] [threads]
+// Exits with 1 if any configuration allocates.
+
+#include "../Graph.h"
+#include "../Point.h"
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <cstdio>
+#include <cstdlib>
+
+static std::atomic<size_t> n_allocs(0);
+
+void *operator new(size_t n)
+{
+	++n_allocs;
+	if (void *p = malloc(n ? n : 1)) return p;
+	throw std::bad_alloc();
+}
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+int main(int argc, char *argv[])
+{
+	const int frames = argc > 1 ? std::max(1, atoi(argv[1])) : 50;
+	const int threads = argc > 2 ? atoi(argv[2]) : 0;
+	const int w = 256, h = 192;
+
+	int failed = 0, n = 0;
+	for (int c = 0; c < 64; ++c)
+	{
+		const bool single = c & 1, blocking = c & 2, fused = c & 4, sparse = c & 8;
+		const int d = c & 16 ? 2 : 1; // downsampled
+		Point::vis = c & 32 ? 1 : 0; // for Maxwell and Klein-Gordon, the impulse is not a local view
+
+		Graph g;
+		g.zoom(1);
+		g.timezoom(3);
+		g.threads(threads);
+		g.single_precision(single);
+		g.temporal_blocking(blocking);
+		g.fused_display(fused);
+		g.sparse_tracking(sparse);
+		g.grid(d * w, d * h);
+		g.resize(w, h);
+
+		GL_Image spare[3];
+		for (int f = 0; f < 10; ++f) { g.update(); g.swap_image(spare[f % 3]); }
+
+		size_t a0 = n_allocs;
+		auto t0 = std::chrono::steady_clock::now();
+		for (int f = 0; f < frames; ++f) { g.update(); g.swap_image(spare[f % 3]); }
+		std::chrono::duration<double> dt = std::chrono::steady_clock::now() - t0;
+		size_t a = n_allocs - a0;
+
+		++n;
+		if (!a) continue;
+		++failed;
+		printf("%s, %s, %s, %s, downsampled by %d, vis %d: %zu allocations in %d frames (%.2f ms per frame)\n",
+		       single ? "float" : "double", blocking ? "blocked" : "unblocked", fused ? "fused" : "not fused",
+		       sparse ? "sparse" : "dense", d, Point::vis, a, frames, dt.count() * 1e3 / frames);
+	}
+	if (failed) printf("FAILED: Graph::update allocates in %d of %d configurations\n", failed, n);
+	else printf("no allocations in %d frames for all %d configurations\n", frames, n);
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,77 @@
+// Checks that rerunning a Task does not allocate: builds a task shaped like the one of Graph::update
+// (a barrier layer, cyclic evolve layers with neighbour dependencies, a visualize layer on top), runs
+// it a few times to warm up and then counts the calls to operator new over many more runs.
+// The allocations for building and first running the task are reported as well.
+// Build with 'scons bench', run as bench/replay [max threads] [units per layer] [steps]
+// Exits with 1 if the steady state allocates.
+
+#include "../Utility/ThreadMap.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <new>
+#include <cstdio>
+#include <cstdlib>
+
+static std::atomic<size_t> n_allocs(0);
+
+void *operator new(size_t n)
+{
+	++n_allocs;
+	if (void *p = malloc(n ? n : 1)) return p;
+	throw std::bad_alloc();
+}
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+static void build(Task &task, int units, int steps, std::atomic<int> *sink)
+{
+	WorkLayer *layer = NULL;
+	for (int t = 0; t < steps; ++t)
+	{
+		layer = new WorkLayer("copy borders", &task, layer, 0, -1);
+		for (int i = 0; i < 3; ++i) layer->add_unit([=]() { ++sink[i]; });
+
+		layer = new WorkLayer("evolve", &task, layer, 1, -1);
+		layer->set_cyclic();
+		for (int i = 0; i < units; ++i) layer->add_unit([=]() { ++sink[i % 3]; });
+	}
+	layer = new WorkLayer("visualize", &task, layer, 0, 3, -1);
+	layer->set_cyclic();
+	for (int i = 0; i < units; ++i) layer->add_unit([=]() { ++sink[i % 3]; });
+}
+
+int main(int argc, char *argv[])
+{
+	int max_threads = argc > 1 ? atoi(argv[1]) : (int)std::thread::hardware_concurrency();
+	int units = argc > 2 ? atoi(argv[2]) : 64;
+	int steps = argc > 3 ? atoi(argv[3]) : 4;
+	if (max_threads < 1) max_threads = 1;
+
+	std::atomic<int> sink[3];
+	for (auto &s : sink) s = 0;
+
+	bool ok = true;
+	for (int n = 1; ; n = std::min(2*n, max_threads))
+	{
+		Task task;
+		size_t b0 = n_allocs;
+		build(task, units, steps, sink);
+		task.run(n);
+		size_t b = n_allocs - b0;
+		for (int r = 0; r < 10; ++r) task.run(n); // link, size the queues and start the pool threads
+
+		const int reps = 1000;
+		size_t a0 = n_allocs;
+		auto t0 = std::chrono::steady_clock::now();
+		for (int r = 0; r < reps; ++r) task.run(n);
+		std::chrono::duration<double> dt = std::chrono::steady_clock::now() - t0;
+		size_t a = n_allocs - a0;
+
+		printf("%3d threads: %8.2f us per run, %zu allocations in %d runs (building: %zu)\n", n, dt.count() * 1e6 / reps, a, reps, b);
+		if (a) ok = false;
+		if (n == max_threads) break;
+	}
+	if (!ok) printf("FAILED: replaying a task allocates\n");
+	return ok ? 0 : 1;
+}
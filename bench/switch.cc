@@ -0,0 +1,75 @@
+// Checks that changing settings between frames keeps the simulation where it would have been without
+// the change: toggles temporal blocking in the middle of a run (also right after a resample) and compares
+// the image against a run that never left the unblocked steps. Everything runs single threaded and with
+// the given number of threads, the bugs this is after show up reliably in the first.
+// Then switches between a local and a non-local vis with the plan cached and compares the threaded run
+// against a single threaded one. Only Maxwell and Klein-Gordon have a non-local vis (the impulse), and
+// since that part checks the dependencies of the visualize layer, it is best run under ThreadSanitizer.
+// Build with 'scons bench', run as bench/switch [threads]
+// Exits with 1 if any image differs.
+
+#include "../Graph.h"
+#include "../Point.h"
+#include <functional>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+
+/// Runs 60 frames and calls change(g, f) before frame f, returns the last image
+static std::vector<unsigned char> run(bool single, bool sparse, int nthreads, std::function<void(Graph&, int)> change)
+{
+	Graph g;
+	g.zoom(1);
+	g.timezoom(3);
+	g.threads(nthreads);
+	g.single_precision(single);
+	g.sparse_tracking(sparse);
+	g.fused_display(false);
+	g.temporal_blocking(false);
+	g.grid(64, 48);
+	g.resize(64, 48);
+	for (int f = 0; f < 60; ++f) { change(g, f); g.update(); }
+	return g.image().data();
+}
+
+static int check(const char *what, bool single, bool sparse, int nt, const std::vector<unsigned char> &a, const std::vector<unsigned char> &b)
+{
+	int n = 0, m = 0;
+	for (size_t j = 0; j < a.size() && j < b.size(); ++j) if (a[j] != b[j]) { ++n; m = std::max(m, std::abs(a[j] - b[j])); }
+	if (a.size() == b.size() && !n) return 0;
+	printf("%s, %s, %s, %d threads: %d bytes differ, by up to %d\n", what, single ? "float" : "double", sparse ? "sparse" : "dense", nt, n, m);
+	return 1;
+}
+
+int main(int argc, char *argv[])
+{
+	const int threads = argc > 1 ? atoi(argv[1]) : 0;
+
+	int failed = 0, n = 0;
+	for (int c = 0; c < 8; ++c)
+	{
+		const bool single = c & 1, sparse = c & 2;
+		const int nt = c & 4 ? threads : 1;
+
+		// frame 0 is the initial setup, frame 40 resamples to the same torus at another size
+		auto resize = [](Graph &g, int f) { if (f == 40) g.grid(80, 60); };
+		auto ref = run(single, sparse, nt, [&](Graph &g, int f) { resize(g, f); });
+
+		failed += check("blocked after unblocked frames", single, sparse, nt, ref,
+		                run(single, sparse, nt, [&](Graph &g, int f) { resize(g, f); if (f == 30) g.temporal_blocking(true); }));
+		failed += check("blocked after resampling unblocked", single, sparse, nt, ref,
+		                run(single, sparse, nt, [&](Graph &g, int f) { resize(g, f); if (f == 41) g.temporal_blocking(true); }));
+		failed += check("blocked, unblocked and back", single, sparse, nt, ref,
+		                run(single, sparse, nt, [&](Graph &g, int f) { resize(g, f); g.temporal_blocking(f % 3 == 2); }));
+		n += 3;
+
+		auto vis = [](Graph&, int f) { Point::vis = f >= 30 && f < 50 ? 1 : 0; };
+		failed += check("local and non-local vis", single, sparse, nt, run(single, sparse, 1, vis), run(single, sparse, nt, vis));
+		++n;
+		Point::vis = 0;
+	}
+
+	if (failed) printf("FAILED: %d of %d runs differ\n", failed, n);
+	else printf("all %d runs match\n", n);
+	return failed ? 1 : 0;
+}
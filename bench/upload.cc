@@ -0,0 +1,81 @@
+// Compares the two ways Graph::draw gets an image into the window: glDrawPixels with glPixelZoom (the
+// old path) and GL_Stream (texture, pixel buffer objects, blit or textured quad), for a few image sizes.
+// Every frame changes the image and ends with glFinish, so the times include the whole transfer.
+// Build with 'scons bench', run as bench/upload [frames]. For software GL, run it with LIBGL_ALWAYS_SOFTWARE=1.
+
+#include "../Graphs/GL_Stream.h"
+#include <GL/glut.h>
+#include <GL/gl.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static int frames = 100;
+
+/// What Graph::draw does without texture_upload
+static void draw_pixels(const GL_Image &im, int w, int h)
+{
+	glMatrixMode(GL_PROJECTION);
+	glLoadIdentity();
+	glOrtho(0.0, 1.0, 0.0, 1.0, -1.0, 1.0);
+	glMatrixMode(GL_MODELVIEW);
+	glLoadIdentity();
+	glPixelZoom((GLfloat)w / im.w(), (GLfloat)h / im.h());
+	glRasterPos2i(0, 0);
+	glDrawPixels(im.w(), im.h(), GL_RGBA, GL_UNSIGNED_BYTE, im.data().data());
+	glPixelZoom(1, 1);
+}
+
+/// @return ms per frame
+template<typename F> static double time(GL_Image &im, F draw)
+{
+	unsigned char *p = im.redim(im.w(), im.h());
+	draw(); glFinish(); // warm up, allocations
+	auto t0 = std::chrono::steady_clock::now();
+	for (int i = 0; i < frames; ++i)
+	{
+		p[4 * (i % (im.w() * im.h()))] ^= 0xFF; // something changed
+		draw();
+		glFinish();
+	}
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count() * 1e3 / frames;
+}
+
+static void measure(int w, int h)
+{
+	printf("%s, %s, %dx%d viewport\n", (const char*)glGetString(GL_RENDERER), (const char*)glGetString(GL_VERSION), w, h);
+	if (!GL_Stream::supported()) { printf("no pixel buffer objects, nothing to compare\n"); return; }
+	GL_Stream stream;
+
+	const int sizes[][2] = { {w/2, h/2}, {w, h}, {2*w, 2*h} };
+	for (auto &s : sizes)
+	{
+		GL_Image im;
+		unsigned char *p = im.redim(s[0], s[1]);
+		for (size_t i = 0; i < im.data().size(); ++i) p[i] = (unsigned char)(i * 2654435761u >> 24);
+
+		double a = time(im, [&]() { draw_pixels(im, w, h); });
+		double b = time(im, [&]() { stream.draw(im); });
+		printf("%5dx%-5d  glDrawPixels %8.3f ms   GL_Stream %8.3f ms   (%.2fx)\n", s[0], s[1], a, b, a / b);
+	}
+}
+
+static void display()
+{
+	measure(glutGet(GLUT_WINDOW_WIDTH), glutGet(GLUT_WINDOW_HEIGHT));
+	exit(0);
+}
+
+int main(int argc, char *argv[])
+{
+	glutInitWindowSize(1024, 768);
+	glutInit(&argc, argv);
+	if (argc > 1) frames = std::max(1, atoi(argv[1]));
+	glutInitDisplayMode(GLUT_RGBA | GLUT_DOUBLE);
+	glutCreateWindow("upload benchmark");
+	glDisable(GL_DITHER);
+	glutDisplayFunc(display);
+	glutMainLoop();
+	return 0;
+}
@@ -33,8 +33,8 @@ inline cnum sqrt_(double z)
 	else
 		return cnum(0.0, ::sqrt(-z));
 }
-inline cnum ix(const cnum &z) { return cnum(-z.imag(), z.real()); } // z * i
-inline cnum iu(const cnum &z) { return cnum(z.imag(), -z.real()); } // z / i
+template<typename T> inline std::complex<T> ix(const std::complex<T> &z) { return std::complex<T>(-z.imag(), z.real()); } // z * i
+template<typename T> inline std::complex<T> iu(const std::complex<T> &z) { return std::complex<T>(z.imag(), -z.real()); } // z / i
 inline constexpr cnum operator-(const cnum &z) { return cnum(-z.real(), -z.imag()); }
 
 /// Zero test with EPSILON precision
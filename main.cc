@@ -7,23 +7,28 @@
 #include "Graph.h"
 #include "Point.h"
 #include "Graphs/GL_Util.h"
+#include "Kernels/Kernels.h"
+#include "Utility/ThreadMap.h"
+#include "Simulation.h"
+#include <chrono>
+#include <iostream>
 static Graph graph;
+static Simulation sim(graph); // owns graph while it runs, see Simulation::post
+static int win_w, win_h;
 
 static void reshape(int w, int h)
 {
-	graph.viewport(w, h);
+	win_w = w; win_h = h;
+	glViewport(0, 0, w, h);
+	sim.post([w, h](Graph &g) { g.resize(w, h); });
+	sim.frame();
 }
 
-static void key(unsigned char c, int x, int y)
+/// Runs on the simulation thread, between two frames
+static void change(Graph &g, unsigned char c)
 {
-	Graph &g = graph;
-	
 	switch (c)
 	{
-		case 'q':
-		case 'Q':
-		case 27: g.record(false); exit(0);
-
 		case 'r':
 			g.record(!g.recording());
 			g.animate(g.recording());
@@ -35,11 +40,11 @@ static void key(unsigned char c, int x, int y)
 
 		case 8: // Backspace
 			g.reset();
-			glutPostRedisplay();
+			sim.frame();
 			break;
 
 		case 'n':
-			glutPostRedisplay();
+			sim.frame();
 			break;
 
 		case '1': case '2': case '3': case '4': case '5':
@@ -47,32 +52,136 @@ static void key(unsigned char c, int x, int y)
 		{
 			int k = (c == '0' ? 10 : c - '0');
 			g.timezoom(k);
+			g.auto_timezoom(0.0);
 			g.animate(true);
-			glutPostRedisplay();
+			sim.frame();
 			break;
 		}
+		case 'z': // toggle picking the timezoom for 60 frames per second
+			g.auto_timezoom(g.auto_timezoom() > 0.0 ? 0.0 : 1.0 / 60.0);
+			std::cerr << "Automatic timezoom " << (g.auto_timezoom() > 0.0 ? "on" : "off") << std::endl;
+			break;
 
 		case 'v':
 			++Point::vis;
-			glutPostRedisplay();
+			sim.frame();
 			break;
 		case 'V':
 			--Point::vis;
-			glutPostRedisplay();
+			sim.frame();
+			break;
+
+		case 'x': // double the simulation grid, it gets downsampled if it is larger than the window
+		case 'X': // back to following the window
+			if (c == 'x') g.grid(2 * std::max(1, g.grid_w()), 2 * std::max(1, g.grid_h())); else g.grid(0, 0);
+			std::cerr << "Grid " << g.grid_w() << "x" << g.grid_h() << ", downsampled by " << g.downsampling() << std::endl;
+			sim.frame();
+			break;
+
+		case 'p': // toggle float/double, restarts the animation
+			g.single_precision(!g.single_precision());
+			std::cerr << "Simulating in " << (g.single_precision() ? "float" : "double") << std::endl;
+			sim.frame();
+			break;
+
+		case 't': // toggle temporal blocking
+			g.temporal_blocking(!g.temporal_blocking());
+			std::cerr << "Temporal blocking " << (g.temporal_blocking() ? "on" : "off") << std::endl;
+			break;
+
+		case 'F': // toggle displaying the last step while evolving it
+			g.fused_display(!g.fused_display());
+			std::cerr << "Fused display " << (g.fused_display() ? "on" : "off") << std::endl;
+			break;
+
+		case 's': // toggle skipping of inactive blocks
+			g.sparse_tracking(!g.sparse_tracking());
+			std::cerr << "Sparse tracking " << (g.sparse_tracking() ? "on" : "off") << std::endl;
+			break;
+		case 'S': // cycle the threshold for inactive blocks
+			g.quiet_threshold(g.quiet_threshold() <= 0.0 ? 1e-12 : g.quiet_threshold() >= 1e-6 ? 0.0 : g.quiet_threshold() * 1e3);
+			std::cerr << "Quiet threshold " << g.quiet_threshold() << std::endl;
+			break;
+
+		case 'i': // how much time did the threads spend waiting for each other?
+		{
+			TaskStats s = Task::stats();
+			std::cerr << s.waits << " waits for work, " << s.parks << " of them slept, " << s.blocked << "s blocked in total, " << s.steals << " units stolen" << std::endl;
+			std::cerr << g.steps_per_second() << " steps/s, timezoom " << g.timezoom() << std::endl;
+			break;
+		}
+
+		case 'A': // toggle pinning the threads (and their strips) to CPUs
+			Task::pin_threads(!Task::pinned_threads());
+			std::cerr << "Thread pinning " << (Task::pinned_threads() ? "on" : "off") << std::endl;
+			break;
+		case 'N': // where are the pages of the simulation?
+			std::cerr << g.numa_report() << std::endl;
+			break;
+
+		case 'T': // start tracing the threads, the next 'T' saves the trace (see Task::trace)
+			if (!Task::tracing())
+			{
+				Task::trace(true);
+				std::cerr << "Tracing..." << std::endl;
+			}
+			else
+			{
+				Task::trace(false);
+				const char *path = "wplot-trace.json";
+				if (Task::write_trace(path)) std::cerr << "Trace saved to " << path << std::endl;
+				else std::cerr << "Could not write " << path << std::endl;
+			}
+			break;
+
+		case 'C': // toggle reference colors, hsl for every pixel (see ColorMap::precise)
+			ColorMap::precise = !ColorMap::precise;
+			std::cerr << "Reference colors " << (ColorMap::precise ? "on" : "off") << std::endl;
+			sim.frame();
 			break;
 
+		case 'k': // check the row kernels against Point::evolve
+			Kernels::verify = !Kernels::verify;
+			std::cerr << "Kernel verification " << (Kernels::verify ? "on" : "off") << std::endl;
+			break;
+		case 'K': // cycle through the supported row kernels
+		{
+			int i = Kernels::selected();
+			do { i = (i + 1) % Kernels::N_ISA; } while (!Kernels::select((Kernels::ISA)i));
+			std::cerr << "Using " << Kernels::get().name << " kernels" << std::endl;
+			break;
+		}
+
 		case 'a': case 'b': case 'c': case 'd':
 		case 'e': case 'f': case 'g': case 'h':
 			Point::vis = c - 'a';
-			glutPostRedisplay();
+			sim.frame();
 			break;
 	}
 }
 
+static void key(unsigned char c, int x, int y)
+{
+	if (c == 'q' || c == 'Q' || c == 27)
+	{
+		sim.stop();
+		graph.record(false);
+		exit(0);
+	}
+	if (c == 'u') // toggle drawing through a texture (see GL_Stream) or with glDrawPixels, only draw reads it
+	{
+		Graph::texture_upload(!Graph::texture_upload());
+		std::cerr << "Texture upload " << (Graph::texture_upload() ? "on" : "off") << std::endl;
+		glutPostRedisplay();
+		return;
+	}
+	sim.post([c](Graph &g) { change(g, c); });
+}
+
 static void draw()
 {
 	GL_CHECK;
-	graph.draw();
+	Graph::draw(sim.image(), win_w, win_h);
 	GL_CHECK;
 
 	//glFinish();
@@ -91,7 +200,9 @@ static void idle()
 	t0 = t;
 	#endif
 
-	if (graph.animating()) glutPostRedisplay();
+	// the simulation does not wait for us, we only draw its newest frame
+	if (sim.fresh()) glutPostRedisplay();
+	else std::this_thread::sleep_for(std::chrono::milliseconds(1));
 }
 
 static void visible(int vis)
@@ -115,6 +226,8 @@ int main(int argc, char *argv[])
 	glutVisibilityFunc(visible);
 	glutKeyboardFunc(key);
 
+	sim.on_frame = [](const Graph &g) { g.record_frame(); };
+	sim.start();
 	glutMainLoop();
 	return 0;
 }